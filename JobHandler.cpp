@@ -1,12 +1,307 @@
 #include "JobHandler.h"
 #include "base_tools.h"
 
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
 struct Job {
+    size_t id;                                              // stable job number shown to the user
     pid_t pid;
+    int pidfd;                                              // -1 when the kernel has no pidfd_open
     std::string command;
+    JobState state;
+    int status;                                             // raw waitpid status once the job is done
+    bool foreground;
+    std::time_t startedAt;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+    bool haveUsage;                                         // usage below came from wait4()
+    struct rusage usage;
 };
 
 std::vector<Job> jobs;
+std::vector<Job> finishedJobs;                              // most recent finished jobs for 'jobs -l'
+const size_t FINISHED_HISTORY = 16;
+
+namespace {
+    int epollFd = -1;
+    int sigchldPipe[2] = {-1, -1};                          // self-pipe used only when pidfd_open is missing
+
+    void sigchldHandler(int) {
+        int savedErrno = errno;
+        char c = 0;
+        ssize_t ignored = write(sigchldPipe[1], &c, 1);
+        (void)ignored;
+        errno = savedErrno;
+    }
+
+    int eventFd() {
+        if (epollFd < 0) {
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+        }
+        return epollFd;
+    }
+
+    // Old kernels: wake the epoll set from SIGCHLD and sweep every job instead
+    void useSigchldFallback() {
+        if (sigchldPipe[0] >= 0) {
+            return;
+        }
+        if (pipe2(sigchldPipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+            return;
+        }
+        struct sigaction sa = {};
+        sa.sa_handler = sigchldHandler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGCHLD, &sa, nullptr);
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;                                    // pid 0 marks the sweep event
+        epoll_ctl(eventFd(), EPOLL_CTL_ADD, sigchldPipe[0], &ev);
+    }
+
+    void watchJob(Job& job) {
+        job.pidfd = static_cast<int>(syscall(SYS_pidfd_open, job.pid, 0));
+        if (job.pidfd < 0) {
+            useSigchldFallback();
+            return;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = static_cast<uint64_t>(job.pid);
+        epoll_ctl(eventFd(), EPOLL_CTL_ADD, job.pidfd, &ev);
+    }
+
+    void unwatchJob(Job& job) {
+        if (job.pidfd < 0) {
+            return;
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, job.pidfd, nullptr);
+        close(job.pidfd);
+        job.pidfd = -1;
+    }
+
+    void applyStatus(Job& job, int status) {
+        if (WIFSTOPPED(status)) {
+            job.state = JobState::Stopped;
+        } else if (WIFCONTINUED(status)) {
+            job.state = JobState::Running;
+        } else {
+            job.state = JobState::Done;
+            job.status = status;
+            job.finished = std::chrono::steady_clock::now();
+            unwatchJob(job);
+        }
+    }
+
+    // Polls one job without blocking, returns true if its state changed
+    bool updateJob(Job& job, int options) {
+        if (job.state == JobState::Done) {
+            return false;
+        }
+        int status;
+        struct rusage usage;
+        pid_t result = wait4(job.pid, &status, WNOHANG | options, &usage);
+        if (result == job.pid) {
+            JobState before = job.state;
+            applyStatus(job, status);
+            if (job.state == JobState::Done) {
+                job.usage = usage;
+                job.haveUsage = true;
+            }
+            return job.state != before || job.state == JobState::Done;
+        }
+        if (result < 0 && errno == ECHILD) {                // already reaped elsewhere
+            job.state = JobState::Done;
+            job.status = 0;
+            job.finished = std::chrono::steady_clock::now();
+            unwatchJob(job);
+            return true;
+        }
+        return false;
+    }
+
+    Job* findJob(size_t jobIndex) {
+        for (Job& job : jobs) {
+            if (job.id == jobIndex + 1) {
+                return &job;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string describeState(const Job& job) {
+        switch (job.state) {
+            case JobState::Running:
+                return "Running";
+            case JobState::Stopped:
+                return "Stopped";
+            case JobState::Done:
+            default:
+                if (WIFSIGNALED(job.status)) {
+                    return std::string("Killed (") + strsignal(WTERMSIG(job.status)) + ")";
+                }
+                if (WIFEXITED(job.status) && WEXITSTATUS(job.status) != 0) {
+                    return "Exit " + std::to_string(WEXITSTATUS(job.status));
+                }
+                return "Done";
+        }
+    }
+
+    Job newJob(size_t id, pid_t pid, const std::string& command, bool foreground) {
+        Job job = {};
+        job.id = id;
+        job.pid = pid;
+        job.pidfd = -1;
+        job.command = command;
+        job.state = JobState::Running;
+        job.foreground = foreground;
+        job.startedAt = std::time(nullptr);
+        job.started = std::chrono::steady_clock::now();
+        return job;
+    }
+
+    void printJob(const Job& job) {
+        std::cout << "[" << job.id << "] " << describeState(job) << "\t" << job.command << " (PID: " << job.pid << ")\n";
+    }
+
+    void rememberFinished(const Job& job) {
+        finishedJobs.push_back(job);
+        if (finishedJobs.size() > FINISHED_HISTORY) {
+            finishedJobs.erase(finishedJobs.begin());
+        }
+    }
+
+    // Values read from /proc while the job runs, or from wait4() once it is done
+    struct JobSample {
+        double wall = 0;
+        double user = 0;
+        double sys = 0;
+        uint64_t maxRss = 0;                                // bytes
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+        bool haveIo = false;
+    };
+
+    bool readProcFile(const std::string& path, std::string& content) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        content = buffer.str();
+        return true;
+    }
+
+    uint64_t procField(const std::string& content, const std::string& key) {
+        size_t pos = content.find(key);
+        if (pos == std::string::npos) {
+            return 0;
+        }
+        return std::strtoull(content.c_str() + pos + key.size(), nullptr, 10);
+    }
+
+    void sampleRunning(const Job& job, JobSample& sample) {
+        std::string proc = "/proc/" + std::to_string(job.pid);
+        std::string content;
+        if (readProcFile(proc + "/stat", content)) {
+            size_t end = content.rfind(')');                 // comm may contain spaces
+            if (end != std::string::npos) {
+                std::istringstream fields(content.substr(end + 2));
+                std::string field;
+                double ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+                for (int i = 3; fields >> field && i <= 15; ++i) {
+                    if (i == 14) {
+                        sample.user = std::strtoull(field.c_str(), nullptr, 10) / ticks;
+                    } else if (i == 15) {
+                        sample.sys = std::strtoull(field.c_str(), nullptr, 10) / ticks;
+                    }
+                }
+            }
+        }
+        if (readProcFile(proc + "/status", content)) {
+            sample.maxRss = procField(content, "VmHWM:") * 1024;
+        }
+        if (readProcFile(proc + "/io", content)) {
+            sample.readBytes = procField(content, "read_bytes:");
+            sample.writeBytes = procField(content, "write_bytes:");
+            sample.haveIo = true;
+        }
+    }
+
+    JobSample sampleJob(const Job& job) {
+        JobSample sample;
+        auto end = (job.state == JobState::Done) ? job.finished : std::chrono::steady_clock::now();
+        sample.wall = std::chrono::duration<double>(end - job.started).count();
+        if (job.haveUsage) {
+            sample.user = job.usage.ru_utime.tv_sec + job.usage.ru_utime.tv_usec / 1e6;
+            sample.sys = job.usage.ru_stime.tv_sec + job.usage.ru_stime.tv_usec / 1e6;
+            sample.maxRss = static_cast<uint64_t>(job.usage.ru_maxrss) * 1024;
+            sample.readBytes = static_cast<uint64_t>(job.usage.ru_inblock) * 512;
+            sample.writeBytes = static_cast<uint64_t>(job.usage.ru_oublock) * 512;
+            sample.haveIo = true;
+        } else if (job.state != JobState::Done) {
+            sampleRunning(job, sample);
+        }
+        return sample;
+    }
+
+    void printJobDetails(const Job& job) {
+        JobSample sample = sampleJob(job);
+        char startedAt[16];
+        std::strftime(startedAt, sizeof(startedAt), "%H:%M:%S", std::localtime(&job.startedAt));
+        std::cout << std::fixed << std::setprecision(2)
+                  << "    started " << startedAt
+                  << "  wall " << sample.wall << "s"
+                  << "  user " << sample.user << "s"
+                  << "  sys " << sample.sys << "s"
+                  << "  maxrss " << formatBytes(sample.maxRss);
+        if (sample.haveIo) {
+            std::cout << "  read " << formatBytes(sample.readBytes)
+                      << "  write " << formatBytes(sample.writeBytes);
+        }
+        std::cout << std::defaultfloat << "\n";
+    }
+
+    void dropFinishedJobs() {
+        for (auto it = jobs.begin(); it != jobs.end();) {
+            if (it->state == JobState::Done) {
+                rememberFinished(*it);
+                it = jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void forgetJob(size_t id) {
+        for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+            if (it->id == id) {
+                unwatchJob(*it);
+                if (it->state == JobState::Done) {
+                    rememberFinished(*it);
+                }
+                jobs.erase(it);
+                return;
+            }
+        }
+    }
+}
 
 void startjob(const std::string& command, char *const argv[]) {
     pid_t pid = fork();
@@ -21,44 +316,150 @@ void startjob(const std::string& command, char *const argv[]) {
         std::cerr << "execvp failed" << std::endl;
         exit(EXIT_FAILURE);
     } else {  // Parent process
-        jobs.push_back({pid, command});
-        std::cout << "Job (" << command << ") started: (PID: " << pid << ")" << std::endl;
+        std::string commandLine = command;
+        for (size_t i = 1; argv[i] != nullptr; ++i) {
+            commandLine += std::string(" ") + argv[i];
+        }
+        size_t id = jobs.empty() ? 1 : jobs.back().id + 1;
+        jobs.push_back(newJob(id, pid, commandLine, false));
+        watchJob(jobs.back());
+        std::cout << "Job [" << id << "] (" << command << ") started: (PID: " << pid << ")" << std::endl;
+    }
+}
+
+int jobEventFd() {
+    return eventFd();
+}
+
+bool reapJobs() {
+    if (epollFd < 0) {
+        return false;
     }
+    bool changed = false;
+    struct epoll_event events[64];
+    int count;
+    do {
+        count = epoll_wait(epollFd, events, 64, 0);
+        for (int i = 0; i < count; ++i) {
+            pid_t pid = static_cast<pid_t>(events[i].data.u64);
+            if (pid == 0) {                                 // SIGCHLD fallback, sweep all jobs
+                char drain[64];
+                while (read(sigchldPipe[0], drain, sizeof(drain)) > 0) {}
+                for (Job& job : jobs) {
+                    changed |= updateJob(job, WUNTRACED | WCONTINUED);
+                }
+                continue;
+            }
+            for (Job& job : jobs) {
+                if (job.pid == pid) {
+                    changed |= updateJob(job, 0);
+                    break;
+                }
+            }
+        }
+    } while (count == 64);
+    return changed;
 }
 
-void listJobs() {
-    for (size_t i = 0; i < jobs.size(); ++i) {
-        std::cout << "Job " << i + 1 << ": " << jobs[i].command << " (PID: " << jobs[i].pid << ")" << std::endl;
+bool notifyJobs() {
+    reapJobs();
+    bool printed = false;
+    for (const Job& job : jobs) {
+        if (job.state == JobState::Done) {
+            printJob(job);
+            printed = true;
+        }
     }
+    dropFinishedJobs();
+    return printed;
+}
+
+void listJobs(bool details) {
+    reapJobs();
+    for (Job& job : jobs) {                                 // pidfds only report exits, pick up stops here
+        updateJob(job, WUNTRACED | WCONTINUED);
+    }
+    for (const Job& job : jobs) {
+        printJob(job);
+        if (details) {
+            printJobDetails(job);
+        }
+    }
+    dropFinishedJobs();
+    if (details && !finishedJobs.empty()) {
+        std::cout << "Recently finished:\n";
+        for (const Job& job : finishedJobs) {
+            std::cout << (job.foreground ? "[fg] " : "[bg] ") << describeState(job) << "\t" << job.command << " (PID: " << job.pid << ")\n";
+            printJobDetails(job);
+        }
+    }
+}
+
+pid_t waitForegroundJob(pid_t pid, const std::string& command, int* status) {
+    Job job = newJob(0, pid, command, true);
+    struct rusage usage;
+    pid_t result = wait4(pid, status, 0, &usage);
+    if (result == pid) {
+        job.state = JobState::Done;
+        job.status = *status;
+        job.finished = std::chrono::steady_clock::now();
+        job.usage = usage;
+        job.haveUsage = true;
+        rememberFinished(job);
+    }
+    return result;
 }
 
 void terminateJob(size_t jobIndex) {
-    if (jobIndex < jobs.size()) {
-        kill(jobs[jobIndex].pid, SIGTERM);
-        jobs.erase(jobs.begin() + jobIndex);
-    } else {
+    Job* job = findJob(jobIndex);
+    if (job == nullptr) {
         std::cerr << "Invalid job index" << std::endl;
+        return;
+    }
+    kill(job->pid, SIGTERM);                                // the reaper reports it once it exits
+    if (job->state == JobState::Stopped) {
+        kill(job->pid, SIGCONT);
     }
 }
 
 void bringJobToForeground(size_t jobIndex) {
-    if (jobIndex >= jobs.size()) {
+    Job* job = findJob(jobIndex);
+    if (job == nullptr) {
         std::cerr << "Invalid job index" << std::endl;
         return;
     }
+    if (job->state == JobState::Done) {
+        printJob(*job);
+        forgetJob(job->id);
+        return;
+    }
 
-    pid_t pid = jobs[jobIndex].pid;
+    pid_t pid = job->pid;
     int status;
     tcsetpgrp(STDIN_FILENO, getpgid(pid));  // Set the foreground process group of the terminal
 
     if (kill(-pid, SIGCONT) < 0) {  // Send SIGCONT to the process group to continue the job if it's stopped
         perror("kill (SIGCONT)");
     }
+    job->state = JobState::Running;
 
     // Wait for the process to change state; this will block until the process exits or stops
-    waitpid(pid, &status, WUNTRACED);
+    struct rusage usage;
+    if (wait4(pid, &status, WUNTRACED, &usage) == pid) {
+        applyStatus(*job, status);
+        if (job->state == JobState::Done) {
+            job->usage = usage;
+            job->haveUsage = true;
+        }
+    }
 
     tcsetpgrp(STDIN_FILENO, getpgid(getpid()));  // Set the foreground process group of the terminal back to the shell
+
+    if (job->state == JobState::Done) {
+        forgetJob(job->id);
+    } else {
+        printJob(*job);
+    }
 }
 
 void start_backround(std::vector<std::string>& args) {
@@ -71,4 +472,3 @@ void start_backround(std::vector<std::string>& args) {
     startjob(args[0].c_str() , argv);
     cleanUpArgv(argv);
 }
-
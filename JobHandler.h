@@ -10,11 +10,15 @@
 #include <unistd.h>
 #include <vector>
 
-
+enum class JobState {
+    Running,
+    Stopped,
+    Done
+};
 
 void startjob(const std::string& command, char *const argv[]);
 
-void listJobs();
+void listJobs(bool details = false);
 
 void terminateJob(size_t jobIndex);
 
@@ -22,4 +26,12 @@ void bringJobToForeground(size_t jobIndex);
 
 void start_backround(std::vector<std::string>& args);
 
+int jobEventFd();               // epoll fd that turns readable when a background job changes state
+
+bool reapJobs();                // collect finished background jobs without blocking, true if any changed
+
+bool notifyJobs();              // print and forget finished jobs, true if anything was printed
+
+pid_t waitForegroundJob(pid_t pid, const std::string& command, int* status);   // waitpid() that records the job's resource usage
+
 #endif // JOB_HANDLER_H
@@ -15,7 +15,11 @@
 #include "c_file.h"
 #include "c_gz.h"
 #include "c_ls.h"
+#include "disk_usage.h"
+#include "dir_cache.h"
 #include "export_from_file.h"
+#include "finder.h"
+#include "hash.h"
 #include "math.h"
 #include "pipe.h"
 #include "readline.h"
@@ -57,6 +61,10 @@ enum Command
     PRIMESIVE,
     GZ,
     MV,
+    HASH,
+    STATS,
+    DU,
+    FIND,
     OTHER
 };
 
@@ -86,7 +94,11 @@ Command stringToEnum(const string &command)
         {"mem_test", MEM},
         {"prime_sive", PRIMESIVE},
         {"gz", GZ},
-        {"mv", MV}
+        {"mv", MV},
+        {"hash", HASH},
+        {"stats", STATS},
+        {"du", DU},
+        {"find", FIND}
     };
 
     auto it = commandMap.find(command);
@@ -98,9 +110,37 @@ Command stringToEnum(const string &command)
     return OTHER;
 }
 
+// Replaces wildcard words with the sorted names they match, using the cached directory
+// listings. Quoted words and words that match nothing are passed on unchanged.
+vector<string> expandWildcards(const vector<string> &raw_args)
+{
+    vector<string> expanded;
+    expanded.reserve(raw_args.size());
+    bool insideQuotes = false;
+    for (size_t i = 0; i < raw_args.size(); ++i)
+    {
+        const string &arg = raw_args[i];
+        bool quoted = insideQuotes || arg.front() == '"';
+        if (arg.front() == '"' && !(arg.size() > 1 && arg.back() == '"'))
+        {
+            insideQuotes = true;
+        }
+        else if (insideQuotes && arg.back() == '"')
+        {
+            insideQuotes = false;
+        }
+
+        if (i == 0 || quoted || !dir_cache::has_wildcards(arg) || !dir_cache::glob(arg, expanded))
+        {
+            expanded.push_back(arg);
+        }
+    }
+    return expanded;
+}
+
 void executeCommand(const vector<string> &raw_args)
 {
-    vector<string> args = args::combineArgsBetweenQuotes(raw_args);
+    vector<string> args = args::combineArgsBetweenQuotes(expandWildcards(raw_args));
     Command commandEnum = OTHER;
 
     if (args.back() == "&")
@@ -151,17 +191,20 @@ void executeCommand(const vector<string> &raw_args)
             terminateJob(stringToInt(args[1]) - 1);
             break;
         case JOBS:
-            listJobs();
+            listJobs(args::find_arg(args, "-l"));
             break;
         case BF:
             bringJobToForeground(stringToInt(args[1]) - 1);
             break;
         case LF:
-            listFiles(args[1]);
+            listFiles(args);
             break;
         case OG:
             og(args);
             break;
+        case RUN:
+            run(args);
+            break;
         case MEM:
             mem_read();
             break;
@@ -174,6 +217,18 @@ void executeCommand(const vector<string> &raw_args)
         case MV:
             mv(args);
             break;
+        case HASH:
+            c_hash(args);
+            break;
+        case STATS:
+            c_stats(args);
+            break;
+        case DU:
+            du(args);
+            break;
+        case FIND:
+            c_find(args);
+            break;
         case OTHER:
         default:
             string binaryPath = search_in_PATH(args[0]);
@@ -227,7 +282,7 @@ void executeCommand(const vector<string> &raw_args)
                     // This is the parent process
                     // Wait for the child to finish
                     int status;
-                    if (waitpid(pid, &status, 0) == -1)
+                    if (waitForegroundJob(pid, joinArgs(args), &status) == -1)
                     {
                         perror("waitpid");
                     }
@@ -1,4 +1,12 @@
 #include "base_tools.h"
+#include "c_cp.h"
+#include "copy_tree.h"
+#include "progress.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 namespace fs = std::filesystem;
 void error_message(const std::string& program, const std::string& message) {
@@ -318,19 +326,82 @@ namespace tools {
             error_message_no_halt("cmkdir", e.what());
         }
     }
+    // rename() cannot cross filesystems. Copy to a temporary name next to the destination,
+    // flush it, rename it into place and only then remove the source, so the destination
+    // either appears complete or not at all.
+    bool move_across_devices(const fs::path& source, const fs::path& destination) {
+        struct stat st;
+        if (lstat(source.c_str(), &st) != 0) {
+            error_message_no_halt("c_mv", "Cannot stat '" + source.string() + "': " + strerror(errno));
+            return false;
+        }
+        fs::path parent = fs::absolute(destination).parent_path();
+        fs::path temporary = parent / ("." + destination.filename().string() + ".mv-" + std::to_string(getpid()));
+        bool ok = false;
+        if (S_ISDIR(st.st_mode)) {
+            progress::Meter meter("mv");
+            copy_tree::Options options;
+            options.meter = &meter;
+            copy_tree::Stats stats;
+            ok = copy_tree::copy(source.string(), temporary.string(), options, stats);
+            int fd = open(temporary.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            ok = ok && fd >= 0 && syncfs(fd) == 0;          // one flush for the whole tree
+            if (fd >= 0) close(fd);
+            meter.finish();
+        } else if (S_ISREG(st.st_mode)) {
+            progress::Meter meter("mv");
+            copy_engine::Result result;
+            ok = copy_engine::copy_file(source.string(), temporary.string(), result, copy_engine::Verify::None, &meter);
+            int fd = open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+            ok = ok && fd >= 0 && fsync(fd) == 0;
+            if (fd >= 0) close(fd);
+            meter.add_files();
+            meter.finish({{"method", copy_engine::method_name(result.method)}});
+        } else if (S_ISLNK(st.st_mode)) {
+            std::error_code ec;
+            fs::path target = fs::read_symlink(source, ec);
+            ok = !ec && symlink(target.c_str(), temporary.c_str()) == 0;
+        } else {
+            ok = mknod(temporary.c_str(), st.st_mode, st.st_rdev) == 0;
+        }
+        if (ok) {
+            lchown(temporary.c_str(), st.st_uid, st.st_gid);                    // best effort, needs privileges
+            ok = rename(temporary.c_str(), destination.c_str()) == 0;
+        }
+        std::error_code ec;
+        if (!ok) {
+            error_message_no_halt("c_mv", "Moving '" + source.string() + "' to '" + destination.string() + "' failed: " + strerror(errno));
+            fs::remove_all(temporary, ec);
+            return false;
+        }
+        int directory = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory >= 0) {                               // make the rename itself durable
+            fsync(directory);
+            close(directory);
+        }
+        fs::remove_all(source, ec);
+        if (ec) {
+            error_message_no_halt("c_mv", "Copied to '" + destination.string() + "' but could not remove '" + source.string() + "': " + ec.message());
+            return false;
+        }
+        return true;
+    }
     bool c_mv(const fs::path& source, const fs::path& destination) {
         std::error_code ec;  // For capturing any error messages
-        if (!fs::exists(source, ec)) {
+        if (!fs::exists(fs::symlink_status(source, ec))) {
             error_message_no_halt("c_mv", "Source path does not exist.");
             return false;
         }
-        if (fs::exists(destination, ec)) {
+        if (fs::exists(fs::symlink_status(destination, ec))) {
             error_message_no_halt("c_mv", "Destination path already exists.");
             return false;
         }
         try {
             fs::rename(source, destination);
         } catch (const std::filesystem::filesystem_error& e) {
+            if (e.code() == std::errc::cross_device_link) {
+                return move_across_devices(source, destination);
+            }
             error_message_no_halt("c_mv", e.what());
             return false;
         }
@@ -349,6 +420,16 @@ std::vector<std::string> splitString(const std::string& input, char delimiter) {
     tokens.push_back(input.substr(start, end));
     return tokens;
 }
+std::string joinArgs(const std::vector<std::string>& args) {
+    std::string joined;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) {
+            joined += ' ';
+        }
+        joined += args[i];
+    }
+    return joined;
+}
 std::string search_in_PATH(const std::string& phrase) {
         std::string pathEnv = get_vars::get_PATH_var();
 
@@ -408,17 +489,39 @@ void cmkdir(const std::vector<std::string>& args) {
     }
 }
 void mv(const std::vector<std::string>& args) {
-    if (!args::find_arg(args, args::processArgs(args, "mv"))) {
+    std::vector<fs::path> paths;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-r" || args[i] == "-R") {
+            continue;                                       // directories move either way, accepted for habit
+        }
+        paths.push_back(args[i]);
+    }
+    if (paths.empty()) {
         error_message_no_halt("mv", "no source given.");
         return;
     }
-    if (!args::find_arg(args, args::processArgs_2(args, "mv"))) {
+    if (paths.size() == 1) {
         error_message_no_halt("mv", "no destination given.");
         return;
     }
-    if (tools::c_mv(args::processArgs(args, "mv"), args::processArgs_2(args, "mv"))) {
+    fs::path destination = paths.back();
+    paths.pop_back();
+    bool intoDirectory = fs::is_directory(destination);
+    if (paths.size() > 1 && !intoDirectory) {
+        error_message_no_halt("mv", "target '" + destination.string() + "' is not a directory.");
         return;
     }
+    for (const fs::path& source : paths) {
+        fs::path target = destination;
+        if (intoDirectory) {
+            fs::path name = source.lexically_normal().filename();
+            if (name.empty()) {                             // "dir/" normalizes to a trailing empty name
+                name = source.lexically_normal().parent_path().filename();
+            }
+            target = destination / name;
+        }
+        tools::c_mv(source, target);
+    }
 }
 int stringToInt(const std::string& str) {
     try {
@@ -433,17 +536,51 @@ int stringToInt(const std::string& str) {
     }
     return 0;  // Return 0 on failure
 }
-void listFiles(const std::string& directoryPath) {
-    try {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(
-                directoryPath,
-                std::filesystem::directory_options::skip_permission_denied))
-        {
-            std::cout << entry.path() << '\n';
+std::string formatBytes(std::uintmax_t bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB", "PB"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024 && unit < 5) {
+        value /= 1024;
+        ++unit;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return buffer;
+}
+// Writes all of data, retrying short writes; false on a write error
+bool write_all(int fd, const char* data, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
-    } catch(const std::filesystem::filesystem_error& e) {
-        std::cerr << e.what() << '\n';
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+bool write_all(int fd, const std::string& data) {
+    return write_all(fd, data.data(), data.size());
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t flushBytes) : fd(fd), flushBytes(flushBytes) {}
+void OutputBuffer::emit(const std::string& batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += batch;
+    if (pending.size() >= flushBytes) {
+        flush_locked();
+    }
+}
+void OutputBuffer::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flush_locked();
+}
+void OutputBuffer::flush_locked() {
+    if (!failed && !write_all(fd, pending)) {
+        failed = true;
     }
+    pending.clear();
 }
 bool bash(const std::string& command, const std::string& input) {
     FILE* pipe = popen(command.c_str(), "w");
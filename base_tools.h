@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <unistd.h>
 #include <vector>
@@ -66,6 +67,7 @@ namespace tools
 }
 
 std::vector<std::string> splitString(const std::string& input, char delimiter);
+std::string joinArgs(const std::vector<std::string>& args);
 std::string search_in_PATH(const std::string& phrase);// move active directory to target
 void itf(const std::vector<std::string>& args);
 void cf(const std::vector<std::string>& args);
@@ -73,7 +75,26 @@ void cd(const std::vector<std::string>& args);
 void cmkdir(const std::vector<std::string>& args);
 void mv(const std::vector<std::string>& args);
 int stringToInt(const std::string& str);
-void listFiles(const std::string& directoryPath);
+std::string formatBytes(std::uintmax_t bytes);
+bool write_all(int fd, const char* data, size_t size);
+bool write_all(int fd, const std::string& data);
+
+// Output from worker threads, written to fd in large chunks. After a failed write (e.g. EPIPE)
+// the rest is dropped, so the caller can still finish its walk.
+struct OutputBuffer {
+    explicit OutputBuffer(int fd = STDOUT_FILENO, size_t flushBytes = 64 * 1024);
+    void emit(const std::string& batch);
+    void flush();
+
+private:
+    void flush_locked();
+
+    int fd;
+    size_t flushBytes;
+    std::mutex mutex;
+    std::string pending;
+    bool failed = false;
+};
 
 void termsize();
 int colums();
@@ -1,89 +1,680 @@
 #include "c_cp.h"
+#include "copy_tree.h"
 #include "base_tools.h"
+#include "hash.h"
+#include "progress.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 namespace fs = std::filesystem;
 
-bool calcCRC32(const std::string& filename, uint32_t& checksum) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        error_message_no_halt("calcCRC32", "Cannot open FILE: '" + filename + "'");
-        return false;
-    }
-    uint32_t crc = 0;
-    char buffer[1024];
-    while (!file.eof()) {
-        file.read(buffer, sizeof(buffer));
-        crc = static_cast<uint32_t>(crc32(crc, reinterpret_cast<const Bytef*>(buffer), static_cast<uInt>(file.gcount())));
-    }
-    file.close();
-    checksum = crc;
-    return true;
-}
-bool Checksum(const std::string& sourcePath, const std::string& destinationPath) {
-    uint32_t source_checksum;
-    uint32_t destination_checksum;
-    if (!calcCRC32(sourcePath, source_checksum)) {
-        error_message_no_halt("calcCRC32", "Failed to calculate checksum for FILE: '" + destinationPath + "'");
-        return false;
-    }
-    if (!calcCRC32(destinationPath, destination_checksum)) {
-        error_message_no_halt("calcCRC32", "Failed to calculate checksum for FILE: '" + destinationPath + "'");
-        return false;
-    }
-    if (source_checksum != destination_checksum) {
-        error_message_no_halt("Checksum", "Dosent Match!!");
-        return false;
-    }
-    return true;
-}
-void copyFile(const std::string& sourcePath, const std::string& destinationPath) {
-    std::ifstream source(sourcePath, std::ios::binary);     // open source file
-    std::ofstream destination(destinationPath, std::ios::binary); // open destination file
-    if (!source) {                                          // if source file coult not be opened tell user and exit function
-        error_message_no_halt("copyFile", "Error opening source file: '" + sourcePath + "'" );
-        return;
+namespace copy_engine {
+    const size_t BUFFER_SIZE = 1 << 20;                     // read/write fallback buffer
+    const size_t KERNEL_CHUNK = 1 << 30;                    // per call limit for copy_file_range/sendfile
+    const size_t PROGRESS_CHUNK = 16 << 20;                 // smaller calls so a progress meter keeps moving
+
+    const char* method_name(Method method) {
+        switch (method) {
+            case Method::Reflink:       return "reflink";
+            case Method::CopyFileRange: return "copy_file_range";
+            case Method::Sendfile:      return "sendfile";
+            case Method::Sparse:        return "sparse";
+            case Method::ReadWrite:
+            default:                    return "read/write";
+        }
     }
-    if (!destination) {                                     // if destination file could not be opened close function
-        error_message_no_halt("copyFile", "Error opening destination file: '" + destinationPath + "'");
-        return;
+
+    // Errors that mean "this mechanism is not available here", not "the copy failed"
+    bool unsupported(int error) {
+        return error == EXDEV || error == ENOSYS || error == EINVAL || error == EOPNOTSUPP || error == ENOTSUP || error == EBADF || error == ETXTBSY;
+    }
+
+    bool copy_read_write(int in, int out, Result& result, bool checksum, progress::Meter* meter) {
+        std::vector<char> buffer(BUFFER_SIZE);
+        uint32_t crc = 0;
+        while (true) {
+            ssize_t n = read(in, buffer.data(), buffer.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (n == 0) {
+                if (checksum) {
+                    result.checksum = crc;
+                    result.haveChecksum = true;
+                }
+                return true;
+            }
+            if (checksum) {                                 // the bytes are hot in cache right now
+                crc = hashing::crc32c_update(crc, buffer.data(), static_cast<size_t>(n));
+            }
+            for (ssize_t written = 0; written < n;) {
+                ssize_t w = write(out, buffer.data() + written, n - written);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                written += w;
+            }
+            result.bytes += n;
+            if (meter) {
+                meter->add_bytes(static_cast<std::uintmax_t>(n));
+            }
+        }
     }
-    destination << source.rdbuf();                          // Use istreambuf_iterator to copy file
-    source.close();                                         // closes source file
-    destination.close();                                    // closes destination file
-    Checksum(sourcePath, destinationPath);
+
+    bool data_extents(int fd, off_t size, std::vector<Extent>& extents) {
+        extents.clear();
+        off_t hole = lseek(fd, 0, SEEK_HOLE);
+        if (hole < 0 || hole >= size) {                     // no holes, or no SEEK_HOLE support
+            lseek(fd, 0, SEEK_SET);
+            return false;
+        }
+        bool ok = true;
+        for (off_t position = 0; position < size;) {
+            off_t data = lseek(fd, position, SEEK_DATA);
+            if (data < 0 || data >= size) {
+                ok = (data >= 0 || errno == ENXIO);         // ENXIO: only a hole is left
+                break;
+            }
+            off_t end = lseek(fd, data, SEEK_HOLE);
+            if (end < 0) {
+                ok = false;
+                break;
+            }
+            end = std::min(end, size);
+            extents.push_back({data, end - data});
+            position = end;
+        }
+        lseek(fd, 0, SEEK_SET);
+        return ok;
+    }
+
+    // Copies [offset, offset + length) to the same offset in out, stopping early at EOF
+    bool copy_range(int in, int out, off_t offset, off_t length) {
+        off_t inOffset = offset;
+        off_t outOffset = offset;
+        while (length > 0) {
+            ssize_t n = copy_file_range(in, &inOffset, out, &outOffset, static_cast<size_t>(std::min<off_t>(length, KERNEL_CHUNK)), 0);
+            if (n > 0) {
+                length -= n;
+                continue;
+            }
+            if (n == 0) {
+                return true;
+            }
+            if (errno == EINTR) continue;
+            if (!unsupported(errno)) {
+                return false;
+            }
+            std::vector<char> buffer(BUFFER_SIZE);          // no in-kernel copy here, pump it ourselves
+            while (length > 0) {
+                ssize_t r = pread(in, buffer.data(), static_cast<size_t>(std::min<off_t>(length, BUFFER_SIZE)), inOffset);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) {
+                    return r == 0;
+                }
+                for (ssize_t done = 0; done < r;) {
+                    ssize_t w = pwrite(out, buffer.data() + done, r - done, outOffset + done);
+                    if (w < 0) {
+                        if (errno == EINTR) continue;
+                        return false;
+                    }
+                    done += w;
+                }
+                inOffset += r;
+                outOffset += r;
+                length -= r;
+            }
+        }
+        return true;
+    }
+
+    // CRC32C of crc followed by length zero bytes, in O(log length) via crc32c_combine
+    uint32_t crc32c_zeros(uint32_t crc, uint64_t length) {
+        static const char zeros[4096] = {};
+        uint32_t piece = hashing::crc32c_update(0, zeros, sizeof(zeros));
+        uint64_t pieceLength = sizeof(zeros);
+        uint64_t blocks = length / sizeof(zeros);
+        for (; blocks > 0; blocks >>= 1) {
+            if (blocks & 1) {
+                crc = hashing::crc32c_combine(crc, piece, pieceLength);
+            }
+            piece = hashing::crc32c_combine(piece, piece, pieceLength);
+            pieceLength *= 2;
+        }
+        return hashing::crc32c_update(crc, zeros, length % sizeof(zeros));
+    }
+
+    bool copy_sparse(int in, int out, off_t size, const std::vector<Extent>& extents, Result& result, bool checksum, progress::Meter* meter) {
+        std::vector<char> buffer(checksum ? BUFFER_SIZE : 0);
+        uint32_t crc = 0;
+        off_t position = 0;
+        for (const Extent& extent : extents) {
+            if (checksum) {                                 // holes read back as zeros
+                crc = crc32c_zeros(crc, static_cast<uint64_t>(extent.offset - position));
+            }
+            if (!checksum) {
+                if (!copy_range(in, out, extent.offset, extent.length)) {
+                    return false;
+                }
+            } else {
+                for (off_t offset = extent.offset; offset < extent.offset + extent.length;) {
+                    size_t want = static_cast<size_t>(std::min<off_t>(extent.offset + extent.length - offset, BUFFER_SIZE));
+                    ssize_t n = pread(in, buffer.data(), want, offset);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        if (n == 0) errno = EIO;                    // source shrank under us
+                        return false;
+                    }
+                    crc = hashing::crc32c_update(crc, buffer.data(), static_cast<size_t>(n));
+                    for (ssize_t done = 0; done < n;) {
+                        ssize_t w = pwrite(out, buffer.data() + done, n - done, offset + done);
+                        if (w < 0) {
+                            if (errno == EINTR) continue;
+                            return false;
+                        }
+                        done += w;
+                    }
+                    offset += n;
+                }
+            }
+            position = extent.offset + extent.length;
+            if (meter) {
+                meter->add_bytes(static_cast<std::uintmax_t>(extent.length));
+            }
+        }
+        if (ftruncate(out, size) != 0) {                    // sets the length and leaves the tail as a hole
+            return false;
+        }
+        if (checksum) {
+            result.checksum = crc32c_zeros(crc, static_cast<uint64_t>(size - position));
+            result.haveChecksum = true;
+        }
+        result.bytes = static_cast<std::uintmax_t>(size);
+        for (const Extent& extent : extents) {
+            size -= extent.length;
+        }
+        result.holeBytes = static_cast<std::uintmax_t>(size);
+        return true;
+    }
+
+    bool copy_fd(int in, int out, std::uintmax_t size, Result& result, Verify verify, progress::Meter* meter) {
+        result = Result();
+        if (ioctl(out, FICLONE, in) == 0) {                 // shared extents cannot differ, nothing to verify
+            result.method = Method::Reflink;
+            result.bytes = size;
+            if (meter) {
+                meter->add_bytes(size);
+            }
+            return true;
+        }
+        std::vector<Extent> extents;
+        if (data_extents(in, static_cast<off_t>(size), extents)) {     // only the data is read and written
+            result.method = Method::Sparse;
+            return copy_sparse(in, out, static_cast<off_t>(size), extents, result, verify != Verify::None, meter);
+        }
+        if (size > 0) {
+            fallocate(out, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));   // best effort, limits fragmentation
+        }
+        if (verify != Verify::None) {                       // data must pass through us to be checksummed
+            result.method = Method::ReadWrite;
+            return copy_read_write(in, out, result, true, meter);
+        }
+
+        size_t chunk = meter ? PROGRESS_CHUNK : KERNEL_CHUNK;
+        result.method = Method::CopyFileRange;
+        while (true) {
+            ssize_t n = copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+            if (n > 0) {
+                result.bytes += n;
+                if (meter) {
+                    meter->add_bytes(static_cast<std::uintmax_t>(n));
+                }
+                continue;
+            }
+            if (n == 0) {
+                return true;
+            }
+            if (errno == EINTR) continue;
+            if (result.bytes > 0 || !unsupported(errno)) {
+                return false;
+            }
+            break;
+        }
+
+        result.method = Method::Sendfile;
+        while (true) {
+            ssize_t n = sendfile(out, in, nullptr, chunk);
+            if (n > 0) {
+                result.bytes += n;
+                if (meter) {
+                    meter->add_bytes(static_cast<std::uintmax_t>(n));
+                }
+                continue;
+            }
+            if (n == 0) {
+                return true;
+            }
+            if (errno == EINTR) continue;
+            if (result.bytes > 0 || !unsupported(errno)) {
+                return false;
+            }
+            break;
+        }
+
+        result.method = Method::ReadWrite;
+        return copy_read_write(in, out, result, false, meter);
+    }
+
+    // With device set, reads the file back past the page cache so the checksum reflects what
+    // reached the device; otherwise the cached pages, which is what the copy loop wrote
+    bool reread_checksum(const std::string& path, uint32_t& checksum, bool device) {
+        int fd = device ? open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC) : -1;
+        bool direct = fd >= 0;
+        if (!direct) {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            if (device) {                                   // e.g. tmpfs, drop the cached pages instead
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            }
+        }
+        void* buffer = nullptr;
+        if (posix_memalign(&buffer, 4096, BUFFER_SIZE) != 0) {
+            close(fd);
+            return false;
+        }
+        uint32_t crc = 0;
+        bool ok = true;
+        while (true) {
+            ssize_t n = read(fd, buffer, BUFFER_SIZE);
+            if (n < 0 && errno == EINVAL && direct) {      // O_DIRECT accepted at open but not for reads
+                direct = false;
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                ok = false;
+                break;
+            }
+            if (n == 0) break;
+            crc = hashing::crc32c_update(crc, buffer, static_cast<size_t>(n));
+        }
+        free(buffer);
+        close(fd);
+        checksum = crc;
+        return ok;
+    }
+
+    bool copy_file(const std::string& sourcePath, const std::string& destinationPath, Result& result, Verify verify, progress::Meter* meter) {
+        int in = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            error_message_no_halt("copy_file", "Error opening source file: '" + sourcePath + "': " + strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(in, &st) != 0) {
+            error_message_no_halt("copy_file", "Cannot stat '" + sourcePath + "': " + strerror(errno));
+            close(in);
+            return false;
+        }
+        int out = open(destinationPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+        if (out < 0) {
+            error_message_no_halt("copy_file", "Error opening destination file: '" + destinationPath + "': " + strerror(errno));
+            close(in);
+            return false;
+        }
+        posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        bool ok = copy_fd(in, out, static_cast<std::uintmax_t>(st.st_size), result, verify, meter);
+        if (!ok) {
+            error_message_no_halt("copy_file", "Copy '" + sourcePath + "' -> '" + destinationPath + "' failed: " + strerror(errno));
+        } else {
+            struct timespec times[2] = {st.st_atim, st.st_mtim};
+            fchmod(out, st.st_mode & 07777);                // open() mode is filtered by umask
+            futimens(out, times);
+            if (verify == Verify::Strict && result.haveChecksum) {
+                fdatasync(out);
+            }
+        }
+        close(in);
+        if (close(out) != 0 && ok) {
+            error_message_no_halt("copy_file", "Error closing '" + destinationPath + "': " + strerror(errno));
+            ok = false;
+        }
+        if (ok && verify != Verify::None && result.method != Method::Reflink && result.bytes != static_cast<std::uintmax_t>(st.st_size)) {
+            error_message_no_halt("copy_file", "Size mismatch copying '" + sourcePath + "' (source changed during copy?)");
+            ok = false;
+        }
+        if (ok && verify != Verify::None && result.haveChecksum) {
+            uint32_t destinationChecksum = 0;
+            if (!reread_checksum(destinationPath, destinationChecksum, verify == Verify::Strict)) {
+                error_message_no_halt("copy_file", "Cannot re-read '" + destinationPath + "' for verification");
+                ok = false;
+            } else if (destinationChecksum != result.checksum) {
+                error_message_no_halt("Checksum", "Dosent Match!!");
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    const size_t DELTA_BLOCK = 64 * 1024;
+    const size_t DELTA_CHUNK = 64;                          // blocks compared per read
+    const char JOURNAL_MAGIC[8] = {'S', 'H', 'J', 'R', 'N', 'L', '1', '\0'};
+
+    struct JournalRecord {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t crc;                                       // CRC32C of the saved bytes
+    };
+
+    std::string journal_path(const std::string& destinationPath) {
+        return destinationPath + ".cp-journal";
+    }
+
+    bool read_full(int fd, void* data, size_t size, off_t offset, size_t& got) {
+        got = 0;
+        while (got < size) {
+            ssize_t n = pread(fd, static_cast<char*>(data) + got, size - got, offset + static_cast<off_t>(got));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+            if (n == 0) break;
+            got += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool write_full(int fd, const void* data, size_t size, off_t offset) {
+        for (size_t done = 0; done < size;) {
+            ssize_t n = pwrite(fd, static_cast<const char*>(data) + done, size - done, offset + static_cast<off_t>(done));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool recover_journal(const std::string& destinationPath) {
+        std::string journalPath = journal_path(destinationPath);
+        int journal = open(journalPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (journal < 0) {
+            return errno == ENOENT;                         // nothing to undo
+        }
+        char magic[8];
+        uint64_t oldSize = 0;
+        size_t got = 0;
+        if (!read_full(journal, magic, sizeof(magic), 0, got) || got != sizeof(magic) || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0 ||
+            !read_full(journal, &oldSize, sizeof(oldSize), sizeof(magic), got) || got != sizeof(oldSize)) {
+            close(journal);                                 // header never reached the disk, so neither did any write
+            unlink(journalPath.c_str());
+            return true;
+        }
+        int out = open(destinationPath.c_str(), O_WRONLY | O_CLOEXEC);
+        if (out < 0) {
+            error_message_no_halt("recover_journal", "Cannot open '" + destinationPath + "': " + strerror(errno));
+            close(journal);
+            return false;
+        }
+        std::vector<char> data(DELTA_BLOCK);
+        off_t position = sizeof(magic) + sizeof(oldSize);
+        size_t restored = 0;
+        bool ok = true;
+        while (true) {
+            JournalRecord record;
+            if (!read_full(journal, &record, sizeof(record), position, got) || got != sizeof(record) || record.length > DELTA_BLOCK) {
+                break;                                      // a torn tail was never followed by a destination write
+            }
+            if (!read_full(journal, data.data(), record.length, position + sizeof(record), got) || got != record.length ||
+                hashing::crc32c_update(0, data.data(), record.length) != record.crc) {
+                break;
+            }
+            if (!write_full(out, data.data(), record.length, static_cast<off_t>(record.offset))) {
+                ok = false;
+                break;
+            }
+            position += sizeof(record) + record.length;
+            ++restored;
+        }
+        ok = ok && ftruncate(out, static_cast<off_t>(oldSize)) == 0 && fdatasync(out) == 0;
+        close(out);
+        close(journal);
+        if (!ok) {
+            error_message_no_halt("recover_journal", "Rolling back '" + destinationPath + "' failed: " + strerror(errno));
+            return false;
+        }
+        unlink(journalPath.c_str());
+        std::cout << "cp: rolled back an interrupted update of '" << destinationPath << "' (" << restored << " blocks)\n";
+        return true;
+    }
+
+    // Compares both files block by block at the same offsets. Changed blocks are saved to the
+    // journal, the journal is synced, and only then are the new blocks written in place, one
+    // chunk at a time. Old blocks past the new end are journaled before the final truncate.
+    bool update_delta(const std::string& sourcePath, const std::string& destinationPath, DeltaResult& result) {
+        result = DeltaResult();
+        if (!recover_journal(destinationPath)) {
+            return false;
+        }
+        int in = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            error_message_no_halt("update_delta", "Error opening source file: '" + sourcePath + "': " + strerror(errno));
+            return false;
+        }
+        int out = open(destinationPath.c_str(), O_RDWR | O_CLOEXEC);
+        if (out < 0) {
+            error_message_no_halt("update_delta", "Error opening destination file: '" + destinationPath + "': " + strerror(errno));
+            close(in);
+            return false;
+        }
+        struct stat sourceStat;
+        struct stat destinationStat;
+        fstat(in, &sourceStat);
+        fstat(out, &destinationStat);
+        posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(out, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        std::string journalPath = journal_path(destinationPath);
+        int journal = -1;
+        off_t journalSize = 0;
+        auto open_journal = [&]() {                         // created lazily, unchanged files never touch it
+            journal = open(journalPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if (journal < 0) {
+                return false;
+            }
+            uint64_t oldSize = static_cast<uint64_t>(destinationStat.st_size);
+            bool ok = write_full(journal, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 0) &&
+                      write_full(journal, &oldSize, sizeof(oldSize), sizeof(JOURNAL_MAGIC));
+            journalSize = sizeof(JOURNAL_MAGIC) + sizeof(oldSize);
+            return ok;
+        };
+        auto save_old = [&](const char* data, size_t length, off_t offset) {
+            if (journal < 0 && !open_journal()) {
+                return false;
+            }
+            JournalRecord record = {static_cast<uint64_t>(offset), static_cast<uint32_t>(length), hashing::crc32c_update(0, data, length)};
+            bool ok = write_full(journal, &record, sizeof(record), journalSize) &&
+                      write_full(journal, data, length, journalSize + static_cast<off_t>(sizeof(record)));
+            journalSize += sizeof(record) + length;
+            return ok;
+        };
+
+        off_t sourceSize = sourceStat.st_size;
+        off_t destinationSize = destinationStat.st_size;
+        off_t end = std::max(sourceSize, destinationSize);
+        std::vector<char> sourceData(DELTA_BLOCK * DELTA_CHUNK);
+        std::vector<char> destinationData(DELTA_BLOCK * DELTA_CHUNK);
+        std::vector<std::pair<off_t, size_t>> changed;      // offset into the chunk, length
+        bool ok = true;
+        for (off_t chunk = 0; ok && chunk < end; chunk += static_cast<off_t>(sourceData.size())) {
+            size_t sourceGot = 0;
+            size_t destinationGot = 0;
+            if (!read_full(in, sourceData.data(), sourceData.size(), chunk, sourceGot) ||
+                !read_full(out, destinationData.data(), destinationData.size(), chunk, destinationGot)) {
+                ok = false;
+                break;
+            }
+            result.compared += std::max(sourceGot, destinationGot);
+            changed.clear();
+            for (size_t block = 0; block < std::max(sourceGot, destinationGot); block += DELTA_BLOCK) {
+                size_t sourceLength = (block < sourceGot) ? std::min(DELTA_BLOCK, sourceGot - block) : 0;
+                size_t destinationLength = (block < destinationGot) ? std::min(DELTA_BLOCK, destinationGot - block) : 0;
+                result.blocks++;
+                if (sourceLength == destinationLength && memcmp(sourceData.data() + block, destinationData.data() + block, sourceLength) == 0) {
+                    continue;
+                }
+                result.changedBlocks++;
+                if (destinationLength > 0 && !save_old(destinationData.data() + block, destinationLength, chunk + static_cast<off_t>(block))) {
+                    ok = false;
+                    break;
+                }
+                if (sourceLength > 0) {
+                    changed.emplace_back(static_cast<off_t>(block), sourceLength);
+                }
+            }
+            if (!ok || changed.empty()) {
+                continue;
+            }
+            if (journal >= 0 && fdatasync(journal) != 0) {  // old data must be durable before it is overwritten
+                ok = false;
+                break;
+            }
+            for (const auto& block : changed) {
+                if (!write_full(out, sourceData.data() + block.first, block.second, chunk + block.first)) {
+                    ok = false;
+                    break;
+                }
+                result.written += block.second;
+            }
+        }
+        if (ok && journal >= 0) {
+            ok = fdatasync(journal) == 0;                   // covers blocks only cut off by the truncate
+        }
+        if (ok && destinationSize != sourceSize) {
+            ok = ftruncate(out, sourceSize) == 0;
+        }
+        if (ok) {
+            struct timespec times[2] = {sourceStat.st_atim, sourceStat.st_mtim};
+            fchmod(out, sourceStat.st_mode & 07777);
+            futimens(out, times);
+            ok = fdatasync(out) == 0;
+        }
+        int error = errno;
+        close(in);
+        close(out);
+        if (journal >= 0) {
+            close(journal);
+        }
+        if (!ok) {
+            error_message_no_halt("update_delta", "Update of '" + destinationPath + "' failed: " + strerror(error));
+            recover_journal(destinationPath);
+            return false;
+        }
+        unlink(journalPath.c_str());                        // the update is committed once the journal is gone
+        return true;
+    }
+}
+
+bool copyFile(const std::string& sourcePath, const std::string& destinationPath, copy_engine::Verify verify) {
+    copy_engine::Result result;
+    return copy_engine::copy_file(sourcePath, destinationPath, result, verify);
 }
-void c_cp(const std::string& sourcePath, const std::string& destinationPath, bool force) {
+void c_cp(const std::string& sourcePath, const std::string& destinationPath, bool force, copy_engine::Verify verify) {
     if (!fs::exists(sourcePath)) {
         error_message_no_halt("c_cp", "Source FILE: '" + sourcePath + "' does not exist");
         return;
     }
-    if (!fs::exists(destinationPath)) {
-        copyFile(sourcePath, destinationPath);
-        return;
-    }
-    if (!force){
+    if (fs::exists(destinationPath) && !force) {
         char answer;
         std::cout << "c_cp: Destination FILE: '" << destinationPath << "' Does exist\nc_cp: do you want to overwrite FILE ?: ";
         std::cin >> answer;
-        if (answer == 'Y' || answer == 'y') {
-            copyFile(sourcePath, destinationPath);
+        if (answer != 'Y' && answer != 'y') {
+            return;
         }
-        return;
     }
-    copyFile(sourcePath, destinationPath);
+    progress::Meter meter("cp");                            // after the prompt, the status line would cover it
+    std::error_code ec;
+    std::uintmax_t size = fs::file_size(sourcePath, ec);
+    meter.set_total(ec ? 0 : size, 1);
+    copy_engine::Result result;
+    if (copy_engine::copy_file(sourcePath, destinationPath, result, verify, &meter)) {
+        meter.add_files();
+    }
+    meter.finish({{"method", copy_engine::method_name(result.method)}});
 }
 
 void cp(const std::vector<std::string>& args) {
-    if (args.size() == 4) {
-        if (args[3] == "-f") {
-            c_cp(args[1], args[2], true);
-            return;
+    bool force = false;
+    bool recursive = false;
+    bool delta = false;
+    unsigned threads = 0;
+    copy_engine::Verify verify = copy_engine::Verify::Stream;
+    std::vector<std::string> paths;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-f") {
+            force = true;
+        } else if (args[i] == "-r" || args[i] == "-R") {
+            recursive = true;
+        } else if (args[i] == "-j" && i + 1 < args.size()) {
+            threads = static_cast<unsigned>(std::strtoul(args[++i].c_str(), nullptr, 10));
+        } else if (args[i] == "--update-delta") {
+            delta = true;
+        } else if (args[i] == "--fast") {
+            verify = copy_engine::Verify::None;
+        } else if (args[i] == "--strict") {
+            verify = copy_engine::Verify::Strict;
+        } else {
+            paths.push_back(args[i]);
+        }
+    }
+    if (paths.size() == 2 && recursive && fs::is_directory(paths[0])) {
+        copy_tree::Options options;
+        options.force = force;
+        options.verify = verify;
+        options.walkThreads = threads;
+        options.ioThreads = threads;
+        copy_tree::Stats stats;
+        progress::Meter meter("cp");
+        options.meter = &meter;
+        copy_tree::copy(paths[0], paths[1], options, stats);
+        meter.finish({{"dirs", std::to_string(stats.directories)}, {"symlinks", std::to_string(stats.symlinks)},
+                      {"hardlinks", std::to_string(stats.hardlinks)}, {"skipped", std::to_string(stats.skipped)},
+                      {"errors", std::to_string(stats.errors)}});
+        return;
+    }
+    if (paths.size() == 2 && delta && fs::is_regular_file(paths[1])) {
+        copy_engine::DeltaResult result;
+        if (copy_engine::update_delta(paths[0], paths[1], result)) {
+            std::cout << "cp: " << result.changedBlocks << " of " << result.blocks << " blocks changed, wrote "
+                      << formatBytes(result.written) << " (compared " << formatBytes(result.compared) << ")\n";
         }
+        return;
     }
-    if (args.size() == 3) {
-        c_cp(args[1], args[2], false);
+    if (paths.size() == 2) {
+        c_cp(paths[0], paths[1], force || delta, verify);
         return;
     } else {
-        std::cout << "Usage: cp <source> <destination> <-f> To force overwrite" << std::endl;
+        std::cout << "Usage: cp <source> <destination> <-f> To force overwrite\n"
+                     "       -r        copy directories recursively, in parallel\n"
+                     "       -j N      worker threads for -r (default: one per core)\n"
+                     "       --update-delta  rewrite only the blocks that differ in an existing destination\n"
+                     "       --fast    skip verification (allows copy_file_range/sendfile and batched -r copies)\n"
+                     "       --strict  also re-read the destination with O_DIRECT and compare" << std::endl;
     }
 }
@@ -6,13 +6,66 @@
 #include <string>
 #include <cstdint>
 #include <filesystem>
+#include <sys/types.h>
 #include <vector>
 #include <zlib.h>
 
-bool calcCRC32(const std::string& filename, uint32_t& checksum);
-bool Checksum(const std::string& sourcePath, const std::string& destinationPath);
-void copyFile(const std::string& sourcePath, const std::string& destinationPath);
-void c_cp(const std::string& sourcePath, const std::string& destinationPath, bool force = false);
+namespace progress {
+    class Meter;
+}
+
+namespace copy_engine {
+    enum class Method {
+        Reflink,                    // ioctl(FICLONE), shares extents on btrfs/xfs
+        CopyFileRange,              // in-kernel copy, server side on NFS
+        Sendfile,
+        ReadWrite,                  // plain userspace loop
+        Sparse                      // data extents only, holes recreated at the destination
+    };
+
+    enum class Verify {
+        None,                       // fastest path, no checksum
+        Stream,                     // checksum the data as it streams through, compare with the destination read back
+        Strict                      // Stream, but fdatasync and read the destination back with O_DIRECT
+    };
+
+    struct Result {
+        std::uintmax_t bytes = 0;
+        Method method = Method::ReadWrite;
+        bool haveChecksum = false;
+        uint32_t checksum = 0;      // CRC32C of the copied data when haveChecksum is set
+        std::uintmax_t holeBytes = 0;           // part of bytes that was skipped as holes
+    };
+
+    struct Extent {
+        off_t offset;
+        off_t length;
+    };
+
+    const char* method_name(Method method);
+    // Fills extents with the data regions of fd and returns true if the file has holes
+    bool data_extents(int fd, off_t size, std::vector<Extent>& extents);
+    bool copy_range(int in, int out, off_t offset, off_t length);
+    bool copy_fd(int in, int out, std::uintmax_t size, Result& result, Verify verify = Verify::None, progress::Meter* meter = nullptr);
+    bool copy_file(const std::string& sourcePath, const std::string& destinationPath, Result& result, Verify verify = Verify::None, progress::Meter* meter = nullptr);
+    bool reread_checksum(const std::string& path, uint32_t& checksum, bool device = true);
+
+    struct DeltaResult {
+        std::uintmax_t compared = 0;            // bytes read from each side
+        std::uintmax_t written = 0;             // bytes rewritten in the destination
+        std::uintmax_t blocks = 0;
+        std::uintmax_t changedBlocks = 0;
+    };
+
+    // Brings an existing destination up to date by rewriting only the blocks that differ.
+    // The old contents of every rewritten block go to '<destination>.cp-journal' first, so an
+    // interrupted update is rolled back by recover_journal() (run automatically on the next update).
+    bool update_delta(const std::string& sourcePath, const std::string& destinationPath, DeltaResult& result);
+    bool recover_journal(const std::string& destinationPath);
+}
+
+bool copyFile(const std::string& sourcePath, const std::string& destinationPath, copy_engine::Verify verify = copy_engine::Verify::Stream);
+void c_cp(const std::string& sourcePath, const std::string& destinationPath, bool force = false, copy_engine::Verify verify = copy_engine::Verify::Stream);
 void cp(const std::vector<std::string>& args);
 
 #endif // C_CP_H
@@ -1,9 +1,34 @@
 #include "c_file.h"
 #include "base_tools.h"
+#include "progress.h"
+#include "thread_pool.h"
+#include "walker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/sysmacros.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
 namespace tools {
+    const unsigned INFO_MASK = STATX_BASIC_STATS | STATX_BTIME | STATX_MNT_ID;
+    const size_t FLUSH_BYTES = 64 * 1024;
+    const size_t PATHS_PER_TASK = 256;
+
+    struct InfoState {
+        const InfoOptions* options;
+        progress::Meter* meter;
+        OutputBuffer output;
+        std::mutex errorMutex;
+        std::atomic<uint64_t> errors{0};
+    };
+
     std::uintmax_t getFileSize(const std::string& filePath) {
         try {
             return fs::file_size(filePath);
@@ -18,17 +43,271 @@ namespace tools {
         }
         return true;                                        // Success
     }
-    void display_metadata(const std::string& full_PATH_to_file) {
-        struct stat fileStat;
-        if (!getFileMetadata(full_PATH_to_file, fileStat)) {
-            error_message_no_halt("display_metadata", "Could not retrive metadata for file: '" + full_PATH_to_file + "'");
+
+    const char* type_name(mode_t mode) {
+        switch (mode & S_IFMT) {
+            case S_IFREG:  return "file";
+            case S_IFDIR:  return "directory";
+            case S_IFLNK:  return "symlink";
+            case S_IFIFO:  return "fifo";
+            case S_IFSOCK: return "socket";
+            case S_IFBLK:  return "block";
+            case S_IFCHR:  return "char";
+            default:       return "unknown";
+        }
+    }
+
+    std::string mode_string(mode_t mode) {                  // -rwsr-xr-t, as ls -l prints it
+        const char* types = "?pc?d?b?-?l?s???";
+        std::string text(10, '-');
+        text[0] = types[(mode & S_IFMT) >> 12];
+        const char* letters = "rwxrwxrwx";
+        for (int bit = 0; bit < 9; ++bit) {
+            if (mode & (0400 >> bit)) {
+                text[1 + bit] = letters[bit];
+            }
+        }
+        if (mode & S_ISUID) text[3] = (mode & S_IXUSR) ? 's' : 'S';
+        if (mode & S_ISGID) text[6] = (mode & S_IXGRP) ? 's' : 'S';
+        if (mode & S_ISVTX) text[9] = (mode & S_IXOTH) ? 't' : 'T';
+        return text;
+    }
+
+    // JSON: UTC with nanoseconds, 2026-10-19T13:55:01.123456789Z. Table: local, to the second.
+    void append_time(std::string& out, const struct statx_timestamp& time, bool json) {
+        time_t seconds = static_cast<time_t>(time.tv_sec);
+        struct tm parts;
+        char buffer[48];
+        if (json) {
+            gmtime_r(&seconds, &parts);
+            size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &parts);
+            snprintf(buffer + length, sizeof(buffer) - length, ".%09uZ", time.tv_nsec);
+            out += '"';
+            out += buffer;
+            out += '"';
+        } else {
+            localtime_r(&seconds, &parts);
+            strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &parts);
+            out += buffer;
+        }
+    }
+
+    // Length of the well formed UTF-8 sequence at text[i], 0 if there is none: stray continuation
+    // bytes, truncated sequences, overlong forms, surrogates and anything above U+10FFFF
+    size_t utf8_length(const std::string& text, size_t i) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t length;
+        unsigned char low = 0x80, high = 0xbf;              // allowed range of the second byte
+        if (lead < 0x80) return 1;
+        if (lead < 0xc2) return 0;
+        if (lead < 0xe0) {
+            length = 2;
+        } else if (lead < 0xf0) {
+            length = 3;
+            if (lead == 0xe0) low = 0xa0;
+            if (lead == 0xed) high = 0x9f;
+        } else if (lead < 0xf5) {
+            length = 4;
+            if (lead == 0xf0) low = 0x90;
+            if (lead == 0xf4) high = 0x8f;
+        } else {
+            return 0;
+        }
+        if (i + length > text.size()) return 0;
+        for (size_t k = 1; k < length; ++k) {
+            unsigned char byte = static_cast<unsigned char>(text[i + k]);
+            if (byte < (k == 1 ? low : 0x80) || byte > (k == 1 ? high : 0xbf)) return 0;
+        }
+        return length;
+    }
+
+    // Control characters, quotes and backslashes are escaped. Names are bytes, not text: a byte
+    // that is not part of valid UTF-8 is written as \u00XX so every record still parses, and
+    // append_path() adds the exact bytes alongside.
+    void append_json_string(std::string& out, const std::string& text) {
+        out += '"';
+        char escape[8];
+        for (size_t i = 0; i < text.size();) {
+            char c = text[i];
+            unsigned char byte = static_cast<unsigned char>(c);
+            size_t length = utf8_length(text, i);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (byte < 0x20 || length == 0) {
+                snprintf(escape, sizeof(escape), "\\u%04x", byte);
+                out += escape;
+            } else {
+                out.append(text, i, length);
+                i += length;
+                continue;
+            }
+            ++i;
+        }
+        out += '"';
+    }
+
+    // "path", plus "path_bytes" in hex when the name is not valid UTF-8 and "path" is only an
+    // approximation of it (\u00ff could also be a real U+00FF)
+    void append_path(std::string& out, const std::string& path) {
+        out += "\"path\":";
+        append_json_string(out, path);
+        bool valid = true;
+        for (size_t i = 0, length; valid && i < path.size(); i += length) {
+            length = utf8_length(path, i);
+            valid = length != 0;
+        }
+        if (valid) {
             return;
         }
-        double MB = static_cast<double>(fileStat.st_size) / (1024 * 1024);
-        std::cout << "File Size: " << fileStat.st_size << " bytes or " << MB << " megabytes\n";
-        std::cout << "Last Access Time: " << std::ctime(&fileStat.st_atime);
-        std::cout << "Last Modification Time: " << std::ctime(&fileStat.st_mtime);
-        std::cout << "File Permissions: " << std::oct << fileStat.st_mode << std::dec << std::endl;
+        static const char digits[] = "0123456789abcdef";
+        out += ",\"path_bytes\":\"";
+        for (char c : path) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            out += digits[byte >> 4];
+            out += digits[byte & 15];
+        }
+        out += '"';
+    }
+
+    void append_record(std::string& out, const std::string& path, const struct statx& st, bool json) {
+        bool hasBirth = st.stx_mask & STATX_BTIME;
+        bool hasMount = st.stx_mask & STATX_MNT_ID;
+        char buffer[160];
+        if (!json) {
+            snprintf(buffer, sizeof(buffer), "%-9s %s %5u %6u %6u %14llu  ", type_name(st.stx_mode),
+                     mode_string(st.stx_mode).c_str(), st.stx_nlink, st.stx_uid, st.stx_gid,
+                     static_cast<unsigned long long>(st.stx_size));
+            out += buffer;
+            append_time(out, st.stx_mtime, false);
+            out += "  ";
+            if (hasBirth) {
+                append_time(out, st.stx_btime, false);
+            } else {
+                out += "-                  ";
+            }
+            snprintf(buffer, sizeof(buffer), "  %5s  ", hasMount ? std::to_string(st.stx_mnt_id).c_str() : "-");
+            out += buffer;
+            out += path;
+            out += '\n';
+            return;
+        }
+
+        out += '{';
+        append_path(out, path);
+        snprintf(buffer, sizeof(buffer),
+                 ",\"type\":\"%s\",\"mode\":\"%04o\",\"nlink\":%u,\"uid\":%u,\"gid\":%u,\"size\":%llu,\"blocks\":%llu,"
+                 "\"ino\":%llu,\"dev\":\"%u:%u\",\"mnt_id\":",
+                 type_name(st.stx_mode), st.stx_mode & 07777, st.stx_nlink, st.stx_uid, st.stx_gid,
+                 static_cast<unsigned long long>(st.stx_size), static_cast<unsigned long long>(st.stx_blocks),
+                 static_cast<unsigned long long>(st.stx_ino), st.stx_dev_major, st.stx_dev_minor);
+        out += buffer;
+        out += hasMount ? std::to_string(st.stx_mnt_id) : "null";
+        out += ",\"atime\":";
+        append_time(out, st.stx_atime, true);
+        out += ",\"mtime\":";
+        append_time(out, st.stx_mtime, true);
+        out += ",\"ctime\":";
+        append_time(out, st.stx_ctime, true);
+        out += ",\"btime\":";
+        if (hasBirth) {
+            append_time(out, st.stx_btime, true);
+        } else {
+            out += "null";
+        }
+        out += "}\n";
+    }
+
+    // In the NDJSON stream the failure is a record of its own, so the consumer sees every path
+    void report(InfoState& state, std::string& batch, const std::string& path, int error) {
+        state.errors.fetch_add(1, std::memory_order_relaxed);
+        if (state.options->json) {
+            batch += '{';
+            append_path(batch, path);
+            batch += ",\"error\":";
+            append_json_string(batch, std::strerror(error));
+            batch += "}\n";
+            return;
+        }
+        std::lock_guard<std::mutex> lock(state.errorMutex);
+        error_message_no_halt("file info", "'" + path + "': " + std::strerror(error));
+    }
+
+    void visit(InfoState& state, walker::Directory& directory) {
+        int dirfd = directory.handle->fd;
+        std::string batch;
+        uint64_t files = 0;
+        for (size_t i = 0; i < directory.entries.size(); ++i) {
+            const walker::Entry& entry = directory.entries[i];
+            std::string path = directory.child_path(entry);
+            struct statx st;
+            if (statx(dirfd, entry.name.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, INFO_MASK, &st) != 0) {
+                report(state, batch, path, errno);
+                continue;
+            }
+            append_record(batch, path, st, state.options->json);
+            ++files;
+            if (S_ISDIR(st.stx_mode)) {
+                directory.descend(i);
+            }
+            if (batch.size() >= FLUSH_BYTES) {
+                state.output.emit(batch);
+                batch.clear();
+            }
+        }
+        state.output.emit(batch);
+        if (state.meter) {
+            state.meter->add_files(files);
+        }
+    }
+
+    bool file_info(const std::vector<std::string>& paths, const InfoOptions& options, progress::Meter* meter) {
+        InfoState state;
+        state.options = &options;
+        state.meter = meter;
+
+        // The paths themselves first, in chunks on the pool when there are many of them
+        std::vector<char> walkable(paths.size(), 0);
+        auto stat_range = [&](size_t begin, size_t end) {
+            std::string batch;
+            uint64_t files = 0;
+            int flags = (options.follow ? 0 : AT_SYMLINK_NOFOLLOW) | AT_NO_AUTOMOUNT;
+            for (size_t i = begin; i < end; ++i) {
+                struct statx st;
+                if (statx(AT_FDCWD, paths[i].c_str(), flags, INFO_MASK, &st) != 0) {
+                    report(state, batch, paths[i], errno);
+                    continue;
+                }
+                append_record(batch, paths[i], st, options.json);
+                walkable[i] = options.recursive && S_ISDIR(st.stx_mode);
+                ++files;
+            }
+            state.output.emit(batch);
+            if (meter) {
+                meter->add_files(files);
+            }
+        };
+        if (paths.size() > PATHS_PER_TASK && options.threads != 1) {
+            TaskPool pool(options.threads);
+            for (size_t begin = 0; begin < paths.size(); begin += PATHS_PER_TASK) {
+                size_t end = std::min(paths.size(), begin + PATHS_PER_TASK);
+                pool.submit([&stat_range, begin, end] { stat_range(begin, end); });
+            }
+            pool.wait();
+        } else {
+            stat_range(0, paths.size());
+        }
+
+        bool walked = true;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (walkable[i]) {
+                walked &= walker::walk(paths[i], options.threads, [&state](walker::Directory& directory) {
+                    visit(state, directory);
+                });
+            }
+        }
+        state.output.flush();
+        return walked && state.errors == 0;
     }
 }
 
@@ -44,7 +323,43 @@ void c_file(const std::vector<std::string>& args) {
         return;
     }
     if (args::find_arg(args, "info")) {
-        tools::display_metadata(args::processArgs(args, "info"));
+        tools::InfoOptions options;
+        std::vector<std::string> paths;
+        size_t first = std::find(args.begin(), args.end(), "info") - args.begin() + 1;
+        for (size_t i = first; i < args.size(); ++i) {
+            const std::string& arg = args[i];
+            if (arg == "-r") {
+                options.recursive = true;
+            } else if (arg == "-L") {
+                options.follow = true;
+            } else if (arg == "--json") {
+                options.json = true;
+            } else if (arg == "-j" && i + 1 < args.size()) {
+                options.threads = static_cast<unsigned>(std::max(1, stringToInt(args[++i])));
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                paths.clear();
+                break;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+        if (paths.empty()) {
+            std::cout << "Usage: file info [-r] [-L] [-j <N>] [--json] <paths...>\n"
+                         "       -r      also every entry below the directories given\n"
+                         "       -L      follow symlinks given as paths (never while walking)\n"
+                         "       -j <N>  threads\n"
+                         "       --json  one JSON object per line (NDJSON) instead of the table\n";
+            return;
+        }
+
+        progress::Meter meter("file info", isatty(STDOUT_FILENO) ? progress::Render::Never : progress::Render::Auto);
+        if (!options.json) {
+            std::cout << "TYPE      MODE       LINKS    UID    GID           SIZE  MODIFIED             "
+                         "BORN                 MOUNT  PATH\n";
+        }
+        std::cout.flush();
+        tools::file_info(paths, options, &meter);
+        meter.finish();
         return;
     }
     std::cout << "usage: 'file' <'size', 'info'> <full_PATH_to_file>\n";
@@ -10,10 +10,23 @@
 #include <ctime>
 #include <chrono> // Include the chrono library for time formatting
 
+namespace progress { class Meter; }
+
 namespace tools {
+    struct InfoOptions {
+        bool recursive = false;             // walk directories given as paths
+        bool json = false;                  // one JSON object per line instead of the table
+        bool follow = false;                // stat what symlinks given as paths point to
+        unsigned threads = 0;
+    };
+
     std::uintmax_t getFileSize(const std::string& filePath);
     bool getFileMetadata(const std::string& filename, struct stat& fileStat);
-    void display_metadata(const std::string& full_PATH_to_file);
+
+    // statx() of every path, and of everything below the directories with recursive, on several
+    // threads. Records are written to stdout in batches as they are ready, so in no fixed order.
+    // Returns false if anything could not be stat'ed or read.
+    bool file_info(const std::vector<std::string>& paths, const InfoOptions& options, progress::Meter* meter = nullptr);
 }
 
 void c_file(const std::vector<std::string>& args);
@@ -1,19 +1,309 @@
 #include "c_gz.h"
 #include "base_tools.h"
+#include "c_cp.h"
+#include "progress.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <fcntl.h>
+#include <future>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 
 
 const size_t BLOCK_SIZE = 512;
+const size_t READ_SIZE = 1 << 20;
+const size_t DEFLATE_OUT_SIZE = 256 * 1024;
+const int DEFAULT_LEVEL = 6;                // gzip's default
+const size_t PARALLEL_BLOCK_SIZE = 128 * 1024;  // pigz's default block
+const size_t DICTIONARY_SIZE = 32 * 1024;   // the whole deflate window
+const size_t SPARSE_IN_HEADER = 4;          // map entries that fit in an 'S' header
+const size_t SPARSE_PER_EXTENSION = 21;     // map entries per continuation block
 
-void writeTarHeader(std::ofstream &outStream, const std::string& fileName, size_t fileSize, char entryType) {
-    char header[BLOCK_SIZE] = {0};
-    strncpy(header, fileName.c_str(), 99);
+// One piece of the tar stream for a worker: deflated on its own, primed with the 32 KiB that
+// precede it so matches can still reach back across the boundary
+struct DeflateBlock {
+    std::vector<char> input;
+    std::vector<char> dictionary;
+    std::vector<unsigned char> output;
+    size_t length = 0;
+    uLong crc = 0;
+    bool last = false;
+    bool failed = false;
+    std::promise<void> done;
+    std::future<void> ready;
+};
+
+// Raw deflate of one block. All but the last end on a Z_SYNC_FLUSH, which byte-aligns the output
+// without ending the stream, so the pieces concatenate into one valid deflate stream.
+void deflateBlock(DeflateBlock& block, int level) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        block.failed = true;
+        return;
+    }
+    if (!block.dictionary.empty()) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(block.dictionary.data()),
+                             static_cast<uInt>(block.dictionary.size()));
+    }
+    block.length = block.input.size();
+    block.crc = crc32(0L, reinterpret_cast<const Bytef*>(block.input.data()), static_cast<uInt>(block.length));
+    block.output.resize(deflateBound(&stream, static_cast<uLong>(block.length)) + 16);
+    stream.next_in = reinterpret_cast<Bytef*>(block.input.data());
+    stream.avail_in = static_cast<uInt>(block.length);
+    int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t produced = 0;
+    int result;
+    do {
+        if (produced == block.output.size()) {
+            block.output.resize(block.output.size() * 2);
+        }
+        stream.next_out = block.output.data() + produced;
+        stream.avail_out = static_cast<uInt>(block.output.size() - produced);
+        result = deflate(&stream, flush);
+        produced = block.output.size() - stream.avail_out;
+    } while (result != Z_STREAM_ERROR && (stream.avail_out == 0 || (block.last && result != Z_STREAM_END)));
+    block.failed = result == Z_STREAM_ERROR;
+    block.output.resize(produced);
+    deflateEnd(&stream);
+    std::vector<char>().swap(block.input);
+    std::vector<char>().swap(block.dictionary);
+}
+
+// Where the tar stream goes: straight to the output with level 0, otherwise through deflate()
+// with a gzip wrapper as it is produced. Memory stays at zlib's state (about 256 KiB at level 9)
+// and one output buffer, whatever the size of the archive.
+//
+// With several threads it works like pigz: the stream is cut into blocks that workers deflate
+// at the same time, written back in order as one gzip member whose CRC is folded together with
+// crc32_combine(). At most two blocks per thread are in flight, so memory is still bounded.
+class ArchiveSink {
+public:
+    ArchiveSink(int fd, int level, unsigned threads = 1)
+        : fd(fd), level(level), compress(level > 0), failed(false), produced(0), crc(0), length(0) {
+        if (!compress) {
+            struct stat st;
+            if (fstat(fd, &st) == 0) {
+                direct = S_ISREG(st.st_mode) ? Direct::CopyFileRange : (S_ISFIFO(st.st_mode) ? Direct::Splice : Direct::None);
+            }
+            return;
+        }
+        if (threads > 1) {
+            pool.reset(new TaskPool(threads));
+            maxInFlight = 2 * threads;
+            current.reserve(PARALLEL_BLOCK_SIZE);
+            crc = crc32(0L, Z_NULL, 0);
+            // Fixed gzip header: no name, no mtime, OS unix, XFL as gzip sets it for -9 / -1
+            const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0,
+                                     static_cast<char>(level == 9 ? 2 : (level == 1 ? 4 : 0)), 3};
+            emit(header, sizeof(header));
+            return;
+        }
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            std::cerr << "Cannot initialize deflate.\n";
+            compress = false;
+            failed = true;
+            return;
+        }
+        out.resize(DEFLATE_OUT_SIZE);
+    }
+
+    ~ArchiveSink() {
+        if (pool) {
+            for (const std::shared_ptr<DeflateBlock>& block : inFlight) {
+                block->ready.wait();                        // workers still hold references
+            }
+        } else if (compress) {
+            deflateEnd(&stream);
+        }
+    }
+
+    ArchiveSink(const ArchiveSink&) = delete;
+    ArchiveSink& operator=(const ArchiveSink&) = delete;
+
+    void write(const char* data, size_t size) {
+        if (failed) {
+            return;
+        }
+        if (!compress) {
+            emit(data, size);
+            return;
+        }
+        if (pool) {
+            while (size > 0) {
+                size_t take = std::min(size, PARALLEL_BLOCK_SIZE - current.size());
+                current.insert(current.end(), data, data + take);
+                data += take;
+                size -= take;
+                if (current.size() == PARALLEL_BLOCK_SIZE) {
+                    submit(false);
+                }
+            }
+            return;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in = static_cast<uInt>(size);
+        drain(Z_NO_FLUSH);
+    }
+
+    // The two zero blocks that end a tar archive, then the rest of the deflate stream and the trailer
+    bool finish() {
+        char end[2 * BLOCK_SIZE] = {0};
+        write(end, sizeof(end));
+        if (pool && !failed) {
+            submit(true);
+            while (!inFlight.empty()) {
+                collect();
+            }
+            unsigned char trailer[8];
+            for (int i = 0; i < 4; ++i) {
+                trailer[i] = static_cast<unsigned char>(crc >> (8 * i));
+                trailer[4 + i] = static_cast<unsigned char>(length >> (8 * i));       // size mod 2^32
+            }
+            emit(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+        } else if (compress && !failed) {
+            stream.next_in = nullptr;
+            stream.avail_in = 0;
+            drain(Z_FINISH);
+        }
+        return !failed;
+    }
+
+    // Plain tar only: moves file data to the output inside the kernel, with copy_file_range()
+    // into a regular file or splice() into a pipe. Returns 0 when that is not possible (or at
+    // the end of the file), and the caller reads the data itself.
+    size_t copyFrom(int in, off_t offset, size_t size) {
+        if (failed || direct == Direct::None) {
+            return 0;
+        }
+        loff_t from = offset;
+        ssize_t n;
+        do {
+            n = (direct == Direct::Splice) ? splice(in, &from, fd, nullptr, size, SPLICE_F_MORE)
+                                           : copy_file_range(in, &from, fd, nullptr, size, 0);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            if (errno == EPIPE || errno == ENOSPC || errno == EIO) {
+                failed = true;
+            } else {
+                direct = Direct::None;              // EXDEV, EINVAL, ENOSYS: not for this pair, stop trying
+            }
+            return 0;
+        }
+        produced += static_cast<size_t>(n);
+        return static_cast<size_t>(n);
+    }
+
+    uintmax_t bytesWritten() const { return produced; }
+
+private:
+    enum class Direct { None, CopyFileRange, Splice };
+
+    void emit(const char* data, size_t size) {
+        if (!failed && size > 0 && !write_all(fd, data, size)) {
+            failed = true;                              // e.g. EPIPE when the reader went away
+        }
+        produced += size;
+    }
+
+    void drain(int flush) {
+        do {
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+            if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                failed = true;
+                return;
+            }
+            emit(reinterpret_cast<const char*>(out.data()), out.size() - stream.avail_out);
+            if (failed) {
+                return;
+            }
+        } while (stream.avail_out == 0);
+    }
+
+    void submit(bool last) {
+        auto block = std::make_shared<DeflateBlock>();
+        block->input.swap(current);
+        block->dictionary = tail;
+        block->last = last;
+        block->ready = block->done.get_future();
+        if (!last) {
+            tail.assign(block->input.end() - DICTIONARY_SIZE, block->input.end());     // full blocks only
+            current.reserve(PARALLEL_BLOCK_SIZE);
+        }
+        while (inFlight.size() >= maxInFlight) {
+            collect();
+        }
+        inFlight.push_back(block);
+        int blockLevel = level;
+        pool->submit([block, blockLevel] {
+            deflateBlock(*block, blockLevel);
+            block->done.set_value();
+        });
+    }
+
+    void collect() {                                // the oldest block, in stream order
+        std::shared_ptr<DeflateBlock> block = inFlight.front();
+        inFlight.pop_front();
+        block->ready.wait();
+        if (block->failed) {
+            failed = true;
+            return;
+        }
+        emit(reinterpret_cast<const char*>(block->output.data()), block->output.size());
+        crc = crc32_combine(crc, block->crc, static_cast<z_off_t>(block->length));
+        length += block->length;
+    }
+
+    int fd;
+    int level;
+    bool compress;
+    bool failed;
+    uintmax_t produced;
+    Direct direct = Direct::None;
+    z_stream stream;
+    std::vector<unsigned char> out;
+
+    std::unique_ptr<TaskPool> pool;
+    size_t maxInFlight = 0;
+    std::deque<std::shared_ptr<DeflateBlock>> inFlight;
+    std::vector<char> current;
+    std::vector<char> tail;                         // last 32 KiB of the previous block
+    uLong crc;
+    uintmax_t length;
+};
+
+// Octal when it fits, GNU base-256 otherwise (sizes from 8 GiB up)
+void writeTarNumber(char* field, size_t width, uintmax_t value) {
+    if (value < (static_cast<uintmax_t>(1) << (3 * (width - 1)))) {
+        snprintf(field, width, "%0*jo", static_cast<int>(width - 1), value);
+        return;
+    }
+    memset(field, 0, width);
+    for (size_t i = width - 1; i > 0; --i) {
+        field[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    field[0] = static_cast<char>(0x80);
+}
+
+void fillTarHeader(char* header, const std::string& fileName, uintmax_t fileSize, char entryType) {
+    memcpy(header, fileName.data(), std::min<size_t>(fileName.size(), 100));     // NUL terminated only when shorter
     snprintf(header + 100, 8, "%07o", (entryType == '5') ? 0755 : 0644);
     snprintf(header + 108, 8, "%07o", 0);
     snprintf(header + 116, 8, "%07o", 0);
-    snprintf(header + 124, 12, "%011lo", static_cast<unsigned long>(fileSize));
+    writeTarNumber(header + 124, 12, fileSize);
     snprintf(header + 136, 12, "%011lo", static_cast<unsigned long>(std::time(nullptr)));
     header[156] = entryType;
+}
 
+void finishTarHeader(ArchiveSink& sink, char* header) {
     // Prepare checksum field and calculate checksum
     memset(header + 148, ' ', 8);
     unsigned int checksum = 0;
@@ -22,37 +312,165 @@ void writeTarHeader(std::ofstream &outStream, const std::string& fileName, size_
     }
     snprintf(header + 148, 8, " %06o", checksum);
 
-    outStream.write(header, BLOCK_SIZE);
+    sink.write(header, BLOCK_SIZE);
 }
 
-void writeTarPadding(std::ofstream &outStream, size_t fileSize) {
+void writeTarPadding(ArchiveSink& sink, size_t fileSize) {
     size_t paddingSize = (BLOCK_SIZE - (fileSize % BLOCK_SIZE)) % BLOCK_SIZE;
-    std::vector<char> padding(paddingSize, '\0');
-    outStream.write(padding.data(), paddingSize);
+    char padding[BLOCK_SIZE] = {0};
+    sink.write(padding, paddingSize);
 }
 
-void writeFileToTar(std::ofstream &outFile, const std::string &filePath, const std::string &fileName) {
-    std::ifstream inFile(filePath, std::ios::binary);
-    if (!inFile.is_open()) {
-        std::cerr << "Cannot open file: " << filePath << std::endl;
-        return;
+// ustar holds up to 255 bytes of a path: a prefix of up to 155 and a name of up to 100, split at a slash
+bool splitUstarName(const std::string& path, std::string& prefix, std::string& name) {
+    if (path.size() <= 100) {
+        prefix.clear();
+        name = path;
+        return true;
+    }
+    size_t slash = path.find('/', path.size() - 101);
+    if (slash == std::string::npos || slash == 0 || slash > 155 || slash + 1 == path.size()) {
+        return false;
     }
+    prefix = path.substr(0, slash);
+    name = path.substr(slash + 1);
+    return true;
+}
 
-    inFile.seekg(0, std::ios::end);
-    size_t fileSize = inFile.tellg();
-    inFile.seekg(0, std::ios::beg);
+// PAX extended header ('x') with a "path" record, for names ustar cannot hold. The entry after
+// it still carries the first 100 bytes, for readers that predate PAX.
+void writePaxPath(ArchiveSink& sink, const std::string& fileName) {
+    std::string record = " path=" + fileName + "\n";
+    size_t length = record.size() + 1;                  // the length counts its own digits
+    while (std::to_string(length).size() + record.size() != length) {
+        ++length;
+    }
+    record = std::to_string(length) + record;
 
-    writeTarHeader(outFile, fileName, fileSize, '0');
+    std::string base = fileName;
+    while (base.size() > 1 && base.back() == '/') {
+        base.pop_back();
+    }
+    base = base.substr(base.find_last_of('/') == std::string::npos ? 0 : base.find_last_of('/') + 1);
+    char header[BLOCK_SIZE] = {0};
+    fillTarHeader(header, ("PaxHeaders/" + base).substr(0, 100), record.size(), 'x');
+    memcpy(header + 257, "ustar\0" "00", 8);
+    finishTarHeader(sink, header);
+    sink.write(record.data(), record.size());
+    writeTarPadding(sink, record.size());
+}
 
+void writeTarHeader(ArchiveSink& sink, const std::string& fileName, size_t fileSize, char entryType) {
+    std::string prefix, name;
+    if (!splitUstarName(fileName, prefix, name)) {
+        writePaxPath(sink, fileName);
+        name = fileName.substr(0, 100);
+    }
+    char header[BLOCK_SIZE] = {0};
+    fillTarHeader(header, name, fileSize, entryType);
+    memcpy(header + 257, "ustar\0" "00", 8);
+    memcpy(header + 345, prefix.data(), prefix.size());
+    finishTarHeader(sink, header);
+}
 
-    std::vector<char> buffer(fileSize);
-    inFile.read(buffer.data(), fileSize);
-    outFile.write(buffer.data(), fileSize);
+// Old GNU sparse entry: the header carries the real size and the first four (offset, length)
+// pairs of the data map, continuation blocks carry the rest. Only the data is stored.
+void writeSparseTarHeader(ArchiveSink& sink, const std::string& fileName, uintmax_t realSize, const std::vector<copy_engine::Extent>& map) {
+    uintmax_t stored = 0;
+    for (const copy_engine::Extent& extent : map) {
+        stored += static_cast<uintmax_t>(extent.length);
+    }
+    if (fileName.size() > 100) {
+        writePaxPath(sink, fileName);                   // the GNU sparse fields sit where the ustar prefix would
+    }
+    char header[BLOCK_SIZE] = {0};
+    fillTarHeader(header, fileName, stored, 'S');
+    memcpy(header + 257, "ustar  ", 8);                 // GNU magic, required for 'S'
+    size_t i = 0;
+    for (; i < map.size() && i < SPARSE_IN_HEADER; ++i) {
+        writeTarNumber(header + 386 + i * 24, 12, static_cast<uintmax_t>(map[i].offset));
+        writeTarNumber(header + 398 + i * 24, 12, static_cast<uintmax_t>(map[i].length));
+    }
+    header[482] = (i < map.size()) ? 1 : 0;
+    writeTarNumber(header + 483, 12, realSize);
+    finishTarHeader(sink, header);
 
-    writeTarPadding(outFile, fileSize);
+    while (i < map.size()) {
+        char block[BLOCK_SIZE] = {0};
+        for (size_t j = 0; j < SPARSE_PER_EXTENSION && i < map.size(); ++j, ++i) {
+            writeTarNumber(block + j * 24, 12, static_cast<uintmax_t>(map[i].offset));
+            writeTarNumber(block + j * 24 + 12, 12, static_cast<uintmax_t>(map[i].length));
+        }
+        block[504] = (i < map.size()) ? 1 : 0;
+        sink.write(block, BLOCK_SIZE);
+    }
 }
 
-bool compressFolder(std::ofstream &outFile, const std::string& folderPath, const std::string& rootDir = "") {
+void writeFileToTar(ArchiveSink& sink, const std::string &filePath, const std::string &fileName, progress::Meter* meter = nullptr) {
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "Cannot open file: " << filePath << std::endl;
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    // Sparse files store only their data regions, everything else in one piece
+    std::vector<copy_engine::Extent> extents;
+    if (copy_engine::data_extents(fd, st.st_size, extents)) {
+        std::vector<copy_engine::Extent> map = extents;
+        if (map.empty() || map.back().offset + map.back().length < st.st_size) {
+            map.push_back({st.st_size, 0});                 // marks the trailing hole
+        }
+        writeSparseTarHeader(sink, fileName, static_cast<uintmax_t>(st.st_size), map);
+    } else {
+        extents.assign(1, {0, st.st_size});
+        writeTarHeader(sink, fileName, static_cast<size_t>(st.st_size), '0');
+    }
+
+    // One header, then the data in chunks of at most READ_SIZE: moved by the kernel when the
+    // sink can, read through a buffer no larger than the file otherwise
+    std::vector<char> buffer;
+    size_t written = 0;
+    for (const copy_engine::Extent& extent : extents) {
+        for (off_t offset = extent.offset; offset < extent.offset + extent.length;) {
+            size_t want = static_cast<size_t>(std::min<off_t>(extent.offset + extent.length - offset, READ_SIZE));
+            ssize_t n = static_cast<ssize_t>(sink.copyFrom(fd, offset, want));
+            if (n > 0) {
+                if (meter) {
+                    meter->add_bytes(static_cast<std::uintmax_t>(n));
+                }
+                offset += n;
+                written += static_cast<size_t>(n);
+                continue;
+            }
+            if (buffer.empty()) {
+                buffer.resize(static_cast<size_t>(std::min<off_t>(st.st_size, READ_SIZE)));
+            }
+            n = pread(fd, buffer.data(), want, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {                                   // shrank while archiving, keep the entry size honest
+                std::cerr << "File changed while reading: " << filePath << std::endl;
+                memset(buffer.data(), 0, want);
+                n = static_cast<ssize_t>(want);
+            }
+            sink.write(buffer.data(), static_cast<size_t>(n));
+            if (meter) {
+                meter->add_bytes(static_cast<std::uintmax_t>(n));
+            }
+            offset += n;
+            written += static_cast<size_t>(n);
+        }
+    }
+    close(fd);
+
+    writeTarPadding(sink, written);
+    if (meter) {
+        meter->add_files();
+    }
+}
+
+bool compressFolder(ArchiveSink& sink, const std::string& folderPath, const std::string& rootDir = "", progress::Meter* meter = nullptr) {
     DIR* dir = opendir(folderPath.c_str());
     if (dir == nullptr) {
         std::cerr << "Cannot open directory.\n";
@@ -68,11 +486,11 @@ bool compressFolder(std::ofstream &outFile, const std::string& folderPath, const
         std::string newRootDir = rootDir.empty() ? entry->d_name : (rootDir + "/" + entry->d_name);
 
         if (entry->d_type == DT_REG) {
-            writeFileToTar(outFile, filePath, newRootDir);
+            writeFileToTar(sink, filePath, newRootDir, meter);
         } else if (entry->d_type == DT_DIR) {
-            writeTarHeader(outFile, newRootDir + "/", 0, '5');
-            writeTarPadding(outFile, 0);
-            compressFolder(outFile, filePath, newRootDir);
+            writeTarHeader(sink, newRootDir + "/", 0, '5');
+            writeTarPadding(sink, 0);
+            compressFolder(sink, filePath, newRootDir, meter);
         }
     }
 
@@ -81,19 +499,55 @@ bool compressFolder(std::ofstream &outFile, const std::string& folderPath, const
 }
 
 void gz(const std::vector<std::string>& args) {
-    std::ofstream outFile(args::processArgs(args, "-o"), std::ios::binary);
-    if (!outFile.is_open()) {
+    std::string folder = args::processArgs(args, "-sF");
+    std::string output = args::processArgs(args, "-o");
+    int level = DEFAULT_LEVEL;
+    if (args::find_arg(args, "-l")) {
+        level = std::min(9, std::max(0, stringToInt(args::processArgs(args, "-l"))));
+    }
+    unsigned threads = 1;
+    if (args::find_arg(args, "-j")) {
+        threads = static_cast<unsigned>(std::max(1, stringToInt(args::processArgs(args, "-j"))));
+    }
+    if (folder.empty() || output.empty()) {
+        std::cout << "Usage: gz -sF <folder> -o <archive.tar.gz | -> [-l <0-9>] [-j <N>]\n"
+                     "       -o -    write the archive to stdout\n"
+                     "       -l <N>  deflate level, 1 fastest to 9 smallest, 0 a plain tar (default 6)\n"
+                     "       -j <N>  deflate 128 KiB blocks on N threads, like pigz\n";
+        return;
+    }
+
+    bool toStdout = output == "-";
+    if (toStdout && level > 0 && isatty(STDOUT_FILENO)) {
+        std::cerr << "Refusing to write compressed data to a terminal.\n";
+        return;
+    }
+    int fd = toStdout ? STDOUT_FILENO : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
         std::cerr << "Cannot open output tar file.\n";
         return;
     }
+    std::cout.flush();
 
-    if (args::find_arg(args, "-sF")) {
-        if (compressFolder(outFile, args::processArgs(args, "-sF"))) {
-            std::cout << "SUCCESSFULL\n";
-        } else {
-            std::cout << "Failed to compress\n";
-        }
+    progress::Meter meter("gz");
+    bool ok;
+    uintmax_t archived;
+    {
+        ArchiveSink sink(fd, level, threads);
+        ok = compressFolder(sink, folder, "", &meter);
+        ok = sink.finish() && ok;
+        archived = sink.bytesWritten();
     }
+    if (!toStdout && close(fd) != 0) {
+        ok = false;
+    }
+    meter.finish({{"level", std::to_string(level)}, {"threads", std::to_string(threads)}, {"archive_bytes", std::to_string(archived)}});
 
-    outFile.close();
+    // With -o - stdout is the archive, so the verdict goes to stderr
+    std::ostream& status = toStdout ? std::cerr : std::cout;
+    if (ok) {
+        status << "SUCCESSFULL\n";
+    } else {
+        status << "Failed to compress\n";
+    }
 }
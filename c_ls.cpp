@@ -1,135 +1,727 @@
 #include "c_ls.h"
+#include "base_tools.h"
+#include "dir_cache.h"
+#include "ls_colors.h"
+#include "string_manipulation.h"
+#include "thread_pool.h"
+#include "walker.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <grp.h>
 #include <iostream>
+#include <linux/magic.h>
+#include <mutex>
+#include <pwd.h>
+#include <string_view>
+#include <sys/vfs.h>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 using namespace std;
 
 namespace c_ls_tools
 {
-    bool is_executable(const fs::directory_entry& entry)
+    const size_t STAT_CHUNK = 4096;                     // entries per task when coloring in parallel
+    const size_t COLUMN_GAP = 2;
+    const size_t REMOTE_STAT_CHUNK = 64;                // smaller tasks when each stat is a network round trip
+    const unsigned REMOTE_STAT_THREADS = 32;            // latency bound, so many more threads than cores
+    const size_t PARALLEL_SORT_MIN = 64 * 1024;         // below this one thread sorts faster than the hand-off
+    const unsigned LONG_MASK = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID |
+                               STATX_SIZE | STATX_MTIME | STATX_BLOCKS;
+
+    enum class SortMode
+    {
+        Name,
+        Time,                                           // -t: newest first
+        Size,                                           // -S: largest first
+        Extension,                                      // -X
+        Version                                         // -v: natural order, file2 before file10
+    };
+
+    struct ListOptions
+    {
+        bool hidden = false;
+        bool onePerLine = false;                        // -1, and always when stdout is not a terminal
+        bool across = false;                            // -x: fill rows first instead of columns
+        bool longFormat = false;                        // -l
+        bool human = false;                             // -h inside a -l cluster (-lh), alone it means hidden
+        SortMode sort = SortMode::Name;
+        bool reverse = false;                           // -r
+    };
+
+    void append_quoted(string& out, const string& name)           // same form as streaming an fs::path
+    {
+        out += '"';
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+            }
+            out += c;
+        }
+        out += '"';
+    }
+
+    // GNU ls layout: every column count that could fit is tried in the same pass over the widths,
+    // and the largest count whose line still fits wins. That is O(n * candidates), so the candidates
+    // are kept few: no more columns than cells of the narrowest width fit on a line, and counts
+    // whose line has already overflowed drop off the top of the range as the pass goes. Cells are
+    // already colored; widths are their display widths without the escape codes.
+    void append_columns(string& out, const vector<string>& cells, const vector<size_t>& widths, size_t lineWidth, bool across)
+    {
+        size_t count = cells.size();
+        if (count == 0)
+        {
+            return;
+        }
+        size_t narrowest = std::max<size_t>(1, *std::min_element(widths.begin(), widths.end()));
+        size_t maxColumns = std::max<size_t>(1, std::min(count, (lineWidth + COLUMN_GAP) / (narrowest + COLUMN_GAP)));
+        vector<vector<size_t>> columnWidths(maxColumns);
+        vector<size_t> lineLength(maxColumns, 0);
+        vector<char> fits(maxColumns, 1);
+        for (size_t columns = 1; columns <= maxColumns; ++columns)
+        {
+            columnWidths[columns - 1].assign(columns, 0);
+        }
+        size_t candidates = maxColumns;                     // fits[candidates - 1] holds, or only one is left
+        for (size_t i = 0; i < count && candidates > 1; ++i)
+        {
+            for (size_t columns = 1; columns <= candidates; ++columns)
+            {
+                if (!fits[columns - 1])
+                {
+                    continue;
+                }
+                size_t rows = (count + columns - 1) / columns;
+                size_t column = across ? i % columns : i / rows;
+                size_t width = widths[i] + (column == columns - 1 ? 0 : COLUMN_GAP);
+                size_t& current = columnWidths[columns - 1][column];
+                if (width > current)
+                {
+                    lineLength[columns - 1] += width - current;
+                    current = width;
+                    fits[columns - 1] = lineLength[columns - 1] <= lineWidth;
+                }
+            }
+            while (candidates > 1 && !fits[candidates - 1]) --candidates;
+        }
+        size_t columns = candidates;
+
+        size_t rows = (count + columns - 1) / columns;
+        const vector<size_t>& chosen = columnWidths[columns - 1];
+        for (size_t row = 0; row < rows; ++row)
+        {
+            for (size_t column = 0; column < columns; ++column)
+            {
+                size_t index = across ? row * columns + column : column * rows + row;
+                if (index >= count)
+                {
+                    break;
+                }
+                out += cells[index];
+                size_t next = across ? index + 1 : index + rows;
+                if (column + 1 < columns && next < count)
+                {
+                    out.append(chosen[column] - widths[index], ' ');
+                }
+            }
+            out += '\n';
+        }
+    }
+
+    // Network and userspace filesystems, where every stat is a round trip worth overlapping
+    bool is_remote_filesystem(int dirfd)
+    {
+        struct statfs fs;
+        if (fstatfs(dirfd, &fs) != 0)
+        {
+            return false;
+        }
+        switch (static_cast<unsigned long>(fs.f_type))
+        {
+            case NFS_SUPER_MAGIC:
+            case FUSE_SUPER_MAGIC:
+            case SMB_SUPER_MAGIC:
+            case CIFS_SUPER_MAGIC:
+            case SMB2_SUPER_MAGIC:
+            case CEPH_SUPER_MAGIC:
+            case CODA_SUPER_MAGIC:
+            case AFS_SUPER_MAGIC:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Runs work(begin, end) over [0, count), on a pool when the directory is big or slow
+    void for_each_chunk(int dirfd, size_t count, const function<void(size_t, size_t)>& work)
     {
-        struct stat st;
-        if (lstat(entry.path().c_str(), &st) == 0)
+        bool remote = is_remote_filesystem(dirfd);
+        size_t chunk = remote ? REMOTE_STAT_CHUNK : STAT_CHUNK;
+        if (count <= chunk || (!remote && TaskPool::default_threads() == 1))
         {
-            return (st.st_mode & S_IXUSR) != 0;
+            work(0, count);
+            return;
         }
+        TaskPool pool(remote ? REMOTE_STAT_THREADS : 0);
+        for (size_t begin = 0; begin < count; begin += chunk)
+        {
+            pool.submit([&work, begin, chunk, count] { work(begin, std::min(begin + chunk, count)); });
+        }
+        pool.wait();
+    }
 
-        return false;
+    // uid/gid names live for the whole session; getpwuid() reads /etc/passwd on every call
+    const string& user_name(uid_t uid)
+    {
+        static mutex lock;
+        static unordered_map<uid_t, string> names;
+        lock_guard<mutex> guard(lock);
+        auto it = names.find(uid);
+        if (it == names.end())
+        {
+            struct passwd* pw = getpwuid(uid);
+            it = names.emplace(uid, pw ? string(pw->pw_name) : to_string(uid)).first;
+        }
+        return it->second;
     }
 
-    bool endsWithExtension(const fs::directory_entry &entry, const string &extension)
+    const string& group_name(gid_t gid)
     {
-        std::string entryPath = entry.path().string();
-        size_t dotPosition = entryPath.rfind('.');
-        
-        // Compare the entry's extension with the desired extension (case-insensitive)
-        if (dotPosition != std::string::npos)
+        static mutex lock;
+        static unordered_map<gid_t, string> names;
+        lock_guard<mutex> guard(lock);
+        auto it = names.find(gid);
+        if (it == names.end())
         {
-            std::string entryExtension = entryPath.substr(dotPosition);
-            return entryExtension == extension;
+            struct group* gr = getgrgid(gid);
+            it = names.emplace(gid, gr ? string(gr->gr_name) : to_string(gid)).first;
         }
+        return it->second;
+    }
 
-        // No extension found in the entry's path
-        return false;
+    string permission_string(mode_t mode)
+    {
+        char type = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISFIFO(mode) ? 'p' : S_ISSOCK(mode) ? 's' :
+                    S_ISCHR(mode) ? 'c' : S_ISBLK(mode) ? 'b' : '-';
+        string bits = {type,
+            (mode & S_IRUSR) ? 'r' : '-', (mode & S_IWUSR) ? 'w' : '-',
+            (mode & S_ISUID) ? ((mode & S_IXUSR) ? 's' : 'S') : ((mode & S_IXUSR) ? 'x' : '-'),
+            (mode & S_IRGRP) ? 'r' : '-', (mode & S_IWGRP) ? 'w' : '-',
+            (mode & S_ISGID) ? ((mode & S_IXGRP) ? 's' : 'S') : ((mode & S_IXGRP) ? 'x' : '-'),
+            (mode & S_IROTH) ? 'r' : '-', (mode & S_IWOTH) ? 'w' : '-',
+            (mode & S_ISVTX) ? ((mode & S_IXOTH) ? 't' : 'T') : ((mode & S_IXOTH) ? 'x' : '-')};
+        return bits;
     }
-    
-    void c_ls(const string &full_PATH_to_dir, bool list_hidden = false)
+
+    string human_size(uint64_t bytes)                   // 'ls -h' style: 512, 4.0K, 13M
     {
-        /* cout << "Contents of directory ( " << full_PATH_to_dir << " ):\n"; */
-        try
+        static const char units[] = "KMGTPE";
+        if (bytes < 1024)
         {
-            // Create a vector to store directory entries
-            vector<fs::directory_entry> entries;
-            for (const auto &entry : fs::directory_iterator(full_PATH_to_dir))
+            return to_string(bytes);
+        }
+        double value = static_cast<double>(bytes);
+        size_t unit = 0;
+        for (value /= 1024; value >= 1024 && unit < 5; value /= 1024) ++unit;
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), value < 10 ? "%.1f%c" : "%.0f%c", value, units[unit]);
+        return buffer;
+    }
+
+    string modification_time(const struct statx_timestamp& time, time_t now)
+    {
+        time_t seconds = static_cast<time_t>(time.tv_sec);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char buffer[32];
+        bool recent = seconds <= now && now - seconds < 180 * 24 * 3600;     // six months, like ls
+        strftime(buffer, sizeof(buffer), recent ? "%b %e %H:%M" : "%b %e  %Y", &local);
+        return buffer;
+    }
+
+    void append_padded(string& out, const string& text, size_t width, bool right)
+    {
+        if (right)
+        {
+            out.append(width - std::min(width, text.size()), ' ');
+        }
+        out += text;
+        if (!right)
+        {
+            out.append(width - std::min(width, text.size()), ' ');
+        }
+    }
+
+    // One statx per entry with only the fields the listing prints, AT_STATX_DONT_SYNC so network
+    // filesystems may answer from their attribute cache.
+    void append_long(string& out, int dirfd, const vector<const walker::Entry*>& entries, const ListOptions& options)
+    {
+        size_t count = entries.size();
+        vector<struct statx> stats(count);
+        vector<char> valid(count, 0);                       // written by the chunks in parallel, so not bits
+        vector<string> targets(count);
+        vector<const char*> colors(count);
+        const ls_colors::Theme& theme = ls_colors::Theme::current();
+        for_each_chunk(dirfd, count, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
             {
-                // If list_hidden is false, skip hidden files and directories
-                if (!list_hidden && entry.path().filename().string().front() == '.')
+                const string& name = entries[i]->name;
+                if (statx(dirfd, name.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, LONG_MASK, &stats[i]) != 0)
                 {
                     continue;
                 }
-            
-                // Store the directory entries in the vector
-                entries.push_back(entry);
-            }
-
-            // Sort the vector alphabetically by filename
-            std::sort
-            (
-                entries.begin(),
-                entries.end(),
-                [](const fs::directory_entry& a, const fs::directory_entry& b)
+                valid[i] = 1;
+                colors[i] = theme.color(dirfd, name, stats[i].stx_mode, stats[i].stx_nlink);
+                if (S_ISLNK(stats[i].stx_mode))
                 {
-                    return a.path().filename() < b.path().filename();
+                    char target[PATH_MAX];
+                    ssize_t n = readlinkat(dirfd, name.c_str(), target, sizeof(target));
+                    if (n >= 0)
+                    {
+                        targets[i].assign(target, static_cast<size_t>(n));
+                    }
                 }
-            );
+            }
+        });
 
-            // Print the sorted contents with color coding for directories and executables
-            for (const auto &entry : entries)
+        vector<array<string, 5>> fields(count);             // links, owner, group, size, time
+        array<size_t, 5> widths = {0, 0, 0, 0, 0};
+        uint64_t blocks = 0;
+        time_t now = time(nullptr);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!valid[i])
             {
-                cout << (endsWithExtension(entry, ".msi")  ? "\033[32m" : "");  // Set text color to    green   for     .msi    files
-                cout << (endsWithExtension(entry, ".exe")  ? "\033[32m" : "");  // Set text color to    green   for     .exe    files
-                cout << (endsWithExtension(entry, ".sh")   ? "\033[32m" : "");  // Set text color to    green   for     .sh     files
-                cout << (endsWithExtension(entry, ".gz")   ? "\033[31m" : "");  // Set text color to    red     for     .gz     files
-                cout << (endsWithExtension(entry, ".xz")   ? "\033[31m" : "");  // Set text color to    red     for     .xz     files
-                cout << (endsWithExtension(entry, ".h")    ? "\033[35m" : "");  // Set text color to    red     for     .h      files
-                cout << (endsWithExtension(entry, ".conf") ? "\033[33m" : "");  // Set text color to    red     for     .conf   files
-                cout << (endsWithExtension(entry, ".c")    ? "\033[92m" : "");  // Set text color to    red     for     .c      files
-                cout << (endsWithExtension(entry, ".cpp")  ? "\033[92m" : "");  // Set text color to    red     for     .cpp    files
-                cout << (is_executable(entry) ? "\033[32m" : "");                         // Set text color to    green   for     exec    files
-                cout << (entry.is_directory() ? "\e[1m\e[34m" : "");                      // Set text color to    blue    for     dirs
-                cout << entry.path().filename();
-                cout << "\033[0m";                                                        // Reset text color to default
-                cout << '\n';                                                             // Print a newline
+                continue;
             }
+            const struct statx& st = stats[i];
+            fields[i] = {to_string(st.stx_nlink), user_name(st.stx_uid), group_name(st.stx_gid),
+                         options.human ? human_size(st.stx_size) : to_string(st.stx_size),
+                         modification_time(st.stx_mtime, now)};
+            for (size_t f = 0; f < fields[i].size(); ++f)
+            {
+                widths[f] = std::max(widths[f], fields[i][f].size());
+            }
+            blocks += st.stx_blocks;
         }
-        catch (const exception& e)
+
+        out += "total " + (options.human ? human_size(blocks * 512) : to_string(blocks / 2)) + "\n";
+        for (size_t i = 0; i < count; ++i)
         {
-            cerr << "Error: " << e.what() << endl;
+            if (!valid[i])
+            {
+                out += "?????????? ";
+                append_quoted(out, entries[i]->name);
+                out += '\n';
+                continue;
+            }
+            out += permission_string(stats[i].stx_mode);
+            out += ' ';
+            append_padded(out, fields[i][0], widths[0], true);
+            out += ' ';
+            append_padded(out, fields[i][1], widths[1], false);
+            out += ' ';
+            append_padded(out, fields[i][2], widths[2], false);
+            out += ' ';
+            append_padded(out, fields[i][3], widths[3], true);
+            out += ' ';
+            out += fields[i][4];
+            out += ' ';
+            if (colors[i])
+            {
+                out += colors[i];
+            }
+            append_quoted(out, entries[i]->name);
+            out += theme.reset();
+            if (S_ISLNK(stats[i].stx_mode))
+            {
+                out += " -> ";
+                append_quoted(out, targets[i]);
+            }
+            out += '\n';
         }
     }
-}
 
-void c_ls(const vector<string>& args)
-{
-    if (args[1] == "-h")
+    // Decorated entry: the key is computed once, so comparisons never stat or allocate
+    struct SortKey
     {
-        if (args.size() == 4)
+        int64_t number;                                 // negated mtime in ns or size, so larger sorts first
+        string_view text;                               // extension for -X, name without suffixes for -v
+        const walker::Entry* entry;
+    };
+
+    // ---- version order, as GNU filevercmp() defines it for ls -v ----
+
+    int version_order(char c)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (isdigit(u)) return 0;
+        if (isalpha(u)) return u;
+        if (c == '~') return -1;
+        return u + UCHAR_MAX + 1;
+    }
+
+    // Runs of digits compare as numbers, everything else by version_order()
+    int version_compare(string_view a, string_view b)
+    {
+        auto at = [](string_view s, size_t i) { return i < s.size() ? s[i] : '\0'; };
+        auto digit = [](char c) { return isdigit(static_cast<unsigned char>(c)) != 0; };
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.size() || j < b.size())
         {
-            std::string directoryName = args[2] + " " + args[3];
-            c_ls_tools::c_ls(directoryName, true);
+            while ((i < a.size() && !digit(a[i])) || (j < b.size() && !digit(b[j])))
+            {
+                int x = i < a.size() ? version_order(a[i]) : 0;
+                int y = j < b.size() ? version_order(b[j]) : 0;
+                if (x != y) return x - y;
+                ++i;
+                ++j;
+            }
+            while (at(a, i) == '0') ++i;
+            while (at(b, j) == '0') ++j;
+            int firstDifference = 0;
+            while (digit(at(a, i)) && digit(at(b, j)))
+            {
+                if (!firstDifference) firstDifference = at(a, i) - at(b, j);
+                ++i;
+                ++j;
+            }
+            if (digit(at(a, i))) return 1;
+            if (digit(at(b, j))) return -1;
+            if (firstDifference) return firstDifference;
         }
-        else if (args.size() == 3)
+        return 0;
+    }
+
+    // The name without a trailing run of suffixes like ".tar.gz", which only break ties
+    string_view version_stem(string_view name)
+    {
+        size_t match = string_view::npos;
+        bool readAlpha = false;
+        for (size_t i = 0; i < name.size(); ++i)
         {
-            c_ls_tools::c_ls(args[2], true);
+            unsigned char c = static_cast<unsigned char>(name[i]);
+            if (readAlpha)
+            {
+                readAlpha = false;
+                if (!isalpha(c) && c != '~') match = string_view::npos;
+            }
+            else if (c == '.')
+            {
+                readAlpha = true;
+                if (match == string_view::npos) match = i;
+            }
+            else if (!isalnum(c) && c != '~')
+            {
+                match = string_view::npos;
+            }
         }
-        else if (args.size() == 2)
+        return match == string_view::npos ? name : name.substr(0, match);
+    }
+
+    bool version_less(const SortKey& a, const SortKey& b)
+    {
+        string_view x = a.entry->name;
+        string_view y = b.entry->name;
+        bool hiddenX = x[0] == '.';
+        bool hiddenY = y[0] == '.';
+        if (hiddenX != hiddenY)
         {
-            c_ls_tools::c_ls(fs::current_path().string(), true);
+            return hiddenX;
         }
-        else
+        if (hiddenX)
         {
-            std::cout << "Usage: ls -h <destination>\n";
+            x.remove_prefix(1);
+            y.remove_prefix(1);
         }
+        int order = a.text == b.text && (a.text.size() != x.size() || b.text.size() != y.size())
+            ? version_compare(x, y)                     // same stem, let the suffixes decide
+            : version_compare(a.text, b.text);
+        return order != 0 ? order < 0 : a.entry->name < b.entry->name;
     }
-    else
+
+    // Sorts runs on the pool, then merges neighbouring runs pairwise, each round in parallel
+    template <typename T, typename Less>
+    void parallel_sort(vector<T>& items, Less less)
     {
-        if (args.size() == 3)
+        unsigned threads = TaskPool::default_threads();
+        if (items.size() < PARALLEL_SORT_MIN || threads == 1)
         {
-            std::string directoryName = args[1] + " " + args[2];
-            c_ls_tools::c_ls(directoryName, false);
+            std::sort(items.begin(), items.end(), less);
+            return;
         }
-        else if (args.size() == 2)
+
+        vector<size_t> bounds;
+        for (unsigned run = 0; run <= threads; ++run)
         {
-            std::string command = args[0] + " \"" + args[1] + "\"";
-            c_ls_tools::c_ls(args[1], false);
+            bounds.push_back(items.size() * run / threads);
+        }
+        TaskPool pool(threads);
+        for (size_t run = 0; run + 1 < bounds.size(); ++run)
+        {
+            auto begin = items.begin() + bounds[run];
+            auto end = items.begin() + bounds[run + 1];
+            pool.submit([begin, end, &less] { std::sort(begin, end, less); });
+        }
+        pool.wait();
+
+        vector<T> merged(items.size());
+        while (bounds.size() > 2)
+        {
+            vector<size_t> next;
+            size_t runs = bounds.size() - 1;
+            for (size_t run = 0; run < runs; run += 2)
+            {
+                size_t begin = bounds[run];
+                size_t middle = bounds[run + 1];
+                size_t end = run + 2 <= runs ? bounds[run + 2] : middle;
+                pool.submit([&items, &merged, &less, begin, middle, end]
+                {
+                    std::merge(items.begin() + begin, items.begin() + middle, items.begin() + middle,
+                               items.begin() + end, merged.begin() + begin, less);
+                });
+                next.push_back(begin);
+            }
+            next.push_back(items.size());
+            pool.wait();
+            items.swap(merged);
+            bounds.swap(next);
+        }
+    }
+
+    // The cache hands out entries sorted by name, so that order costs nothing; the other modes
+    // decorate each entry with its key first, stat'ing in parallel when the key needs it.
+    void sort_entries(int dirfd, vector<const walker::Entry*>& entries, const ListOptions& options)
+    {
+        if (options.sort != SortMode::Name)
+        {
+            vector<SortKey> keys(entries.size());
+            bool needStat = options.sort == SortMode::Time || options.sort == SortMode::Size;
+            auto decorate = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const string& name = entries[i]->name;
+                    SortKey& key = keys[i];
+                    key.entry = entries[i];
+                    key.number = 0;
+                    if (needStat)
+                    {
+                        struct statx st;
+                        unsigned mask = options.sort == SortMode::Time ? STATX_MTIME : STATX_SIZE;
+                        if (statx(dirfd, name.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, mask, &st) == 0)
+                        {
+                            key.number = options.sort == SortMode::Time
+                                ? -(static_cast<int64_t>(st.stx_mtime.tv_sec) * 1000000000 + st.stx_mtime.tv_nsec)
+                                : -static_cast<int64_t>(st.stx_size);
+                        }
+                    }
+                    else if (options.sort == SortMode::Extension)
+                    {
+                        size_t dot = name.rfind('.');
+                        if (dot != string::npos && dot > 0)
+                        {
+                            key.text = string_view(name).substr(dot + 1);
+                        }
+                    }
+                    else if (options.sort == SortMode::Version)
+                    {
+                        key.text = version_stem(string_view(name).substr(name[0] == '.' ? 1 : 0));
+                    }
+                }
+            };
+            if (needStat)
+            {
+                for_each_chunk(dirfd, entries.size(), decorate);
+            }
+            else
+            {
+                decorate(0, entries.size());
+            }
+
+            switch (options.sort)
+            {
+                case SortMode::Time:
+                case SortMode::Size:
+                    parallel_sort(keys, [](const SortKey& a, const SortKey& b)
+                    {
+                        return a.number != b.number ? a.number < b.number : a.entry->name < b.entry->name;
+                    });
+                    break;
+                case SortMode::Extension:
+                    parallel_sort(keys, [](const SortKey& a, const SortKey& b)
+                    {
+                        int order = a.text.compare(b.text);
+                        return order != 0 ? order < 0 : a.entry->name < b.entry->name;
+                    });
+                    break;
+                case SortMode::Version:
+                    parallel_sort(keys, version_less);
+                    break;
+                case SortMode::Name:
+                    break;
+            }
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                entries[i] = keys[i].entry;
+            }
         }
-        else if (args.size() == 1)
+        if (options.reverse)
         {
-            c_ls_tools::c_ls(fs::current_path().string(), false);
+            std::reverse(entries.begin(), entries.end());
+        }
+    }
+
+    void c_ls(const string &full_PATH_to_dir, const ListOptions& options)
+    {
+        int dirfd = open(full_PATH_to_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd < 0)
+        {
+            cerr << "Error: cannot open directory '" << full_PATH_to_dir << "': " << strerror(errno) << endl;
+            return;
+        }
+        // Unchanged directories come straight from the listing cache, already sorted by name
+        dir_cache::Snapshot snapshot = dir_cache::lookup(dirfd);
+        if (!snapshot)
+        {
+            cerr << "Error: cannot read directory '" << full_PATH_to_dir << "': " << strerror(errno) << endl;
+            close(dirfd);
+            return;
+        }
+        vector<const walker::Entry*> entries;
+        entries.reserve(snapshot->size());
+        for (const walker::Entry& entry : *snapshot)
+        {
+            if (options.hidden || entry.name[0] != '.')
+            {
+                entries.push_back(&entry);
+            }
+        }
+        sort_entries(dirfd, entries, options);
+
+        if (options.longFormat)
+        {
+            string out;
+            out.reserve(entries.size() * 80);
+            append_long(out, dirfd, entries, options);
+            close(dirfd);
+            cout.flush();
+            write_all(STDOUT_FILENO, out);
+            return;
+        }
+
+        // The fstatat() calls are the only per-entry syscalls left, spread them over the cores
+        const ls_colors::Theme& theme = ls_colors::Theme::current();
+        vector<const char*> colors(entries.size());
+        auto color_range = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                colors[i] = theme.color(dirfd, *entries[i]);
+            }
+        };
+        for_each_chunk(dirfd, entries.size(), color_range);
+
+        // Assemble the whole listing, then hand it to the terminal in one write
+        string out;
+        out.reserve(entries.size() * 32);
+        bool columns = !options.onePerLine && isatty(STDOUT_FILENO);
+        vector<string> cells;
+        vector<size_t> widths;
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            string cell;
+            if (colors[i])
+            {
+                cell += colors[i];
+            }
+            size_t start = cell.size();
+            append_quoted(cell, entries[i]->name);
+            if (columns)
+            {
+                widths.push_back(string_manipulation::display_width(cell.substr(start)));
+            }
+            cell += theme.reset();
+            if (columns)
+            {
+                cells.push_back(std::move(cell));
+            }
+            else
+            {
+                out += cell;
+                out += '\n';
+            }
+        }
+        close(dirfd);
+        if (columns)
+        {
+            int width = colums();
+            append_columns(out, cells, widths, width > 0 ? static_cast<size_t>(width) : 80, options.across);
+        }
+
+        cout.flush();                                       // keep ordering with anything already buffered
+        write_all(STDOUT_FILENO, out);
+    }
+}
+
+void c_ls(const vector<string>& args)
+{
+    // Flags first; whatever is left is the directory, words joined back with spaces so that
+    // unquoted names like 'ls My Documents' keep working.
+    c_ls_tools::ListOptions options;
+    std::string directoryName;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        const std::string& arg = args[i];
+        if (arg.size() > 1 && arg[0] == '-' && directoryName.empty())
+        {
+            bool cluster = arg.find('l') != std::string::npos;  // -h is human sizes only next to -l
+            for (size_t k = 1; k < arg.size(); ++k)
+            {
+                switch (arg[k])
+                {
+                    case 'a': options.hidden = true; break;
+                    case 'h': (cluster ? options.human : options.hidden) = true; break;
+                    case 'l': options.longFormat = true; break;
+                    case '1': options.onePerLine = true; break;
+                    case 'x': options.across = true; break;
+                    case 'C': options.onePerLine = false; break;
+                    case 't': options.sort = c_ls_tools::SortMode::Time; break;
+                    case 'S': options.sort = c_ls_tools::SortMode::Size; break;
+                    case 'X': options.sort = c_ls_tools::SortMode::Extension; break;
+                    case 'v': options.sort = c_ls_tools::SortMode::Version; break;
+                    case 'r': options.reverse = true; break;
+                    default:
+                        std::cout << "Usage: ls [-h|-a] [-l] [-1] [-x] [-C] [-t|-S|-X|-v] [-r] <destination>\n"
+                                     "       -h, -a  show hidden files as well\n"
+                                     "       -l      long format, -lh with human readable sizes\n"
+                                     "       -1      one name per line\n"
+                                     "       -x      fill rows instead of columns\n"
+                                     "       -t      newest first\n"
+                                     "       -S      largest first\n"
+                                     "       -X      by extension\n"
+                                     "       -v      natural order of numbers in names\n"
+                                     "       -r      reverse the order\n";
+                        return;
+                }
+            }
         }
         else
         {
-            std::cout << "Usage: ls <destination> or ls -h <destination> to show hidden files as well\n";
+            directoryName += (directoryName.empty() ? "" : " ") + arg;
         }
     }
+    c_ls_tools::c_ls(directoryName.empty() ? "." : directoryName, options);
 }
@@ -139,9 +139,20 @@ int make_o()
     std::thread t12(clang, output_o("JobHandler"), source_o("JobHandler"), args.o_args, 12);
     std::thread t13(clang, output_o("benchmarks"), source_o("benchmarks"), args.o_args, 13);
     std::thread t14(clang, output_o("c_gz"), source_o("c_gz"), args.o_args, 14);
+    std::thread t15(clang, output_o("hash"), source_o("hash"), args.o_args, 15);
+    std::thread t16(clang, output_o("thread_pool"), source_o("thread_pool"), args.o_args, 16);
+    std::thread t17(clang, output_o("walker"), source_o("walker"), args.o_args, 17);
+    std::thread t18(clang, output_o("copy_tree"), source_o("copy_tree"), args.o_args, 18);
+    std::thread t19(clang, output_o("uring_io"), source_o("uring_io"), args.o_args, 19);
+    std::thread t20(clang, output_o("progress"), source_o("progress"), args.o_args, 20);
+    std::thread t21(clang, output_o("dir_cache"), source_o("dir_cache"), args.o_args, 21);
+    std::thread t22(clang, output_o("finder"), source_o("finder"), args.o_args, 22);
+    std::thread t23(clang, output_o("disk_usage"), source_o("disk_usage"), args.o_args, 23);
+    std::thread t24(clang, output_o("predicate"), source_o("predicate"), args.o_args, 24);
+    std::thread t25(clang, output_o("ls_colors"), source_o("ls_colors"), args.o_args, 25);
 
 
-    t1.join(); t2.join(); t3.join(); t4.join(); t5.join(); t6.join(); t7.join(); t8.join(); t9.join(); t10.join(); t11.join(); t12.join(); t13.join(); t14.join();
+    t1.join(); t2.join(); t3.join(); t4.join(); t5.join(); t6.join(); t7.join(); t8.join(); t9.join(); t10.join(); t11.join(); t12.join(); t13.join(); t14.join(); t15.join(); t16.join(); t17.join(); t18.join(); t19.join(); t20.join(); t21.join(); t22.join(); t23.join(); t24.join(); t25.join();
 
     // Wait for the results and collect them
     int result1 = promiseMap[1].get_future().get();
@@ -158,8 +169,19 @@ int make_o()
     int result12 = promiseMap[12].get_future().get();
     int result13 = promiseMap[13].get_future().get();
     int result14 = promiseMap[14].get_future().get();
-
-    if (result1 == 0 && result2 == 0 && result3 == 0 && result4 == 0 && result5 == 0 && result6 == 0 && result7 == 0 && result8 == 0 && result9 == 0 && result10 == 0 && result11 == 0 && result12 == 0 && result13 == 0 && result14 == 0)
+    int result15 = promiseMap[15].get_future().get();
+    int result16 = promiseMap[16].get_future().get();
+    int result17 = promiseMap[17].get_future().get();
+    int result18 = promiseMap[18].get_future().get();
+    int result19 = promiseMap[19].get_future().get();
+    int result20 = promiseMap[20].get_future().get();
+    int result21 = promiseMap[21].get_future().get();
+    int result22 = promiseMap[22].get_future().get();
+    int result23 = promiseMap[23].get_future().get();
+    int result24 = promiseMap[24].get_future().get();
+    int result25 = promiseMap[25].get_future().get();
+
+    if (result1 == 0 && result2 == 0 && result3 == 0 && result4 == 0 && result5 == 0 && result6 == 0 && result7 == 0 && result8 == 0 && result9 == 0 && result10 == 0 && result11 == 0 && result12 == 0 && result13 == 0 && result14 == 0 && result15 == 0 && result16 == 0 && result17 == 0 && result18 == 0 && result19 == 0 && result20 == 0 && result21 == 0 && result22 == 0 && result23 == 0 && result24 == 0 && result25 == 0)
     {
         std::cout << "\n\nDone turning cpp file(s) to .o\n\n"; return 0;
     }
@@ -191,7 +213,18 @@ int make_exec()
         o_input("readline"),
         o_input("JobHandler"),
         o_input("benchmarks"),
-        o_input("c_gz")
+        o_input("c_gz"),
+        o_input("hash"),
+        o_input("thread_pool"),
+        o_input("walker"),
+        o_input("copy_tree"),
+        o_input("uring_io"),
+        o_input("progress"),
+        o_input("dir_cache"),
+        o_input("finder"),
+        o_input("disk_usage"),
+        o_input("predicate"),
+        o_input("ls_colors")
     };
 
     std::promise<int> resultPromise;
@@ -0,0 +1,552 @@
+#include "copy_tree.h"
+#include "base_tools.h"
+#include "progress.h"
+#include "thread_pool.h"
+#include "uring_io.h"
+#include "walker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+namespace copy_tree {
+    const off_t SMALL_FILE = 64 * 1024;                     // batched, many per task
+    const size_t BATCH_FILES = 64;
+    const off_t BATCH_BYTES = 4 << 20;
+    const off_t STRIPE_SIZE = 64ll << 20;                   // files over two stripes are split across workers
+    const size_t IO_QUEUE = 256;                            // queued copy tasks before the walkers wait
+
+    struct DestDir {
+        walker::Handle handle;
+        std::string path;
+    };
+
+    struct DirFinish {                                      // applied after all files are in place
+        std::string path;
+        mode_t mode;
+        struct timespec times[2];
+        int depth;
+    };
+
+    struct CopyState {
+        Options options;
+        TaskPool* io = nullptr;
+        std::atomic<std::uintmax_t> files{0};
+        std::atomic<std::uintmax_t> bytes{0};
+        std::atomic<std::uintmax_t> directories{0};
+        std::atomic<std::uintmax_t> symlinks{0};
+        std::atomic<std::uintmax_t> hardlinks{0};
+        std::atomic<std::uintmax_t> skipped{0};
+        std::atomic<std::uintmax_t> errors{0};
+        std::mutex mutex;                                   // guards dirs and links
+        std::vector<DirFinish> dirs;
+        std::map<std::pair<dev_t, ino_t>, std::string> links;
+    };
+
+    struct SmallFile {
+        std::string name;
+        struct stat st;
+        int out;                                            // already created hardlink target, or -1
+    };
+
+    struct Batch {
+        walker::Handle source;
+        std::shared_ptr<DestDir> destination;
+        std::vector<SmallFile> files;
+        off_t bytes = 0;
+    };
+
+    void report(CopyState& state, const std::string& message) {
+        error_message_no_halt("cp", message + ": " + strerror(errno));
+        state.errors++;
+    }
+
+    std::string join_path(const std::string& directory, const std::string& name) {
+        return (!directory.empty() && directory.back() == '/') ? directory + name : directory + "/" + name;
+    }
+
+    // Creates the destination file. Existing files are skipped unless forced.
+    int create_destination(CopyState& state, const DestDir& destination, const std::string& name, const struct stat& st) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (state.options.force ? O_TRUNC : O_EXCL);
+        int out = openat(destination.handle->fd, name.c_str(), flags, (st.st_mode & 07777) | S_IWUSR);
+        if (out < 0) {
+            if (errno == EEXIST) {
+                state.skipped++;
+            } else {
+                report(state, "Cannot create '" + join_path(destination.path, name) + "'");
+            }
+        }
+        return out;
+    }
+
+    void finish_file(int out, const struct stat& st) {
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        fchmod(out, st.st_mode & 07777);
+        futimens(out, times);
+    }
+
+    // Small files go through the ring in three rounds: open everything, then a linked
+    // read -> write per file, then close everything. Files that changed size since the
+    // walk saw them drop out of the chain and are finished with copy_engine::copy_range().
+    void copy_batch(CopyState& state, const Batch& batch) {
+        uring_io::Ring& ring = uring_io::thread_ring();
+        size_t count = batch.files.size();
+        std::vector<int> in(count, -1);
+        std::vector<int> out(count, -1);
+        std::vector<uring_io::Request> requests;
+        int createFlags = O_WRONLY | O_CREAT | O_CLOEXEC | (state.options.force ? O_TRUNC : O_EXCL);
+
+        for (size_t i = 0; i < count; ++i) {
+            const SmallFile& file = batch.files[i];
+            uring_io::Request source{uring_io::Op::OpenAt};
+            source.fd = batch.source->fd;
+            source.path = file.name.c_str();
+            source.flags = O_RDONLY | O_CLOEXEC;
+            requests.push_back(source);
+            if (file.out >= 0) {                            // already created as a hardlink target
+                continue;
+            }
+            uring_io::Request destination{uring_io::Op::OpenAt};
+            destination.fd = batch.destination->handle->fd;
+            destination.path = file.name.c_str();
+            destination.flags = createFlags;
+            destination.mode = (file.st.st_mode & 07777) | S_IWUSR;
+            requests.push_back(destination);
+        }
+        ring.run(requests);
+        for (size_t i = 0, next = 0; i < count; ++i) {
+            const SmallFile& file = batch.files[i];
+            long source = requests[next++].result;
+            long destination = file.out;
+            if (file.out < 0) {
+                destination = requests[next++].result;
+            }
+            if (source < 0) {
+                errno = static_cast<int>(-source);
+                report(state, "Cannot open '" + file.name + "'");
+            } else {
+                in[i] = static_cast<int>(source);
+            }
+            if (destination < 0) {
+                errno = static_cast<int>(-destination);
+                if (errno == EEXIST) {
+                    state.skipped++;
+                } else {
+                    report(state, "Cannot create '" + join_path(batch.destination->path, file.name) + "'");
+                }
+            } else {
+                out[i] = static_cast<int>(destination);
+            }
+        }
+
+        std::vector<char> buffer(static_cast<size_t>(batch.bytes));
+        std::vector<size_t> firstRequest(count, SIZE_MAX);
+        requests.clear();
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t size = static_cast<size_t>(batch.files[i].st.st_size);    // at most SMALL_FILE, fits the request length
+            if (in[i] < 0 || out[i] < 0 || size == 0) {
+                continue;
+            }
+            firstRequest[i] = requests.size();
+            uring_io::Request read{uring_io::Op::Read};
+            read.fd = in[i];
+            read.buffer = buffer.data() + offset;
+            read.length = static_cast<unsigned>(size);
+            read.linkNext = true;
+            requests.push_back(read);
+            uring_io::Request write{uring_io::Op::Write};
+            write.fd = out[i];
+            write.buffer = buffer.data() + offset;
+            write.length = static_cast<unsigned>(size);
+            requests.push_back(write);
+            offset += size;
+        }
+        ring.run(requests);
+
+        std::vector<uring_io::Request> closes;
+        for (size_t i = 0; i < count; ++i) {
+            const SmallFile& file = batch.files[i];
+            if (in[i] >= 0 && out[i] >= 0) {
+                bool ok = true;
+                std::uintmax_t copied = static_cast<std::uintmax_t>(file.st.st_size);
+                bool complete = true;
+                if (firstRequest[i] != SIZE_MAX) {
+                    const uring_io::Request& read = requests[firstRequest[i]];
+                    const uring_io::Request& write = requests[firstRequest[i] + 1];
+                    complete = read.result == static_cast<long>(read.length) && write.result == static_cast<long>(write.length);
+                }
+                struct stat source = file.st;               // a file that grew since the walk reads back exactly the old size
+                if (fstat(in[i], &source) != 0 || source.st_size != file.st.st_size) {
+                    complete = false;
+                }
+                if (!complete) {
+                    ok = ftruncate(out[i], 0) == 0 && copy_engine::copy_range(in[i], out[i], 0, LLONG_MAX);
+                    struct stat now;
+                    copied = (ok && fstat(out[i], &now) == 0) ? static_cast<std::uintmax_t>(now.st_size) : 0;
+                }
+                if (ok) {
+                    finish_file(out[i], source);
+                    state.files++;
+                    state.bytes += copied;
+                    if (state.options.meter) {
+                        state.options.meter->add_files();
+                        state.options.meter->add_bytes(copied);
+                    }
+                } else {
+                    report(state, "Copy failed for '" + join_path(batch.destination->path, file.name) + "'");
+                }
+            }
+            for (int fd : {in[i], out[i]}) {
+                if (fd >= 0) {
+                    uring_io::Request close{uring_io::Op::Close};
+                    close.fd = fd;
+                    closes.push_back(close);
+                }
+            }
+        }
+        ring.run(closes);
+    }
+
+    void copy_whole(CopyState& state, walker::Handle source, std::shared_ptr<DestDir> destination, const std::string& name, const struct stat& st, int out) {
+        std::string where = join_path(destination->path, name);
+        int in = openat(source->fd, name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            report(state, "Cannot open '" + name + "'");
+            if (out >= 0) close(out);
+            return;
+        }
+        if (out < 0) {
+            out = create_destination(state, *destination, name, st);
+        }
+        if (out < 0) {
+            close(in);
+            return;
+        }
+        copy_engine::Result result;
+        bool ok = copy_engine::copy_fd(in, out, static_cast<std::uintmax_t>(st.st_size), result, state.options.verify, state.options.meter);
+        if (ok) {
+            finish_file(out, st);
+            if (state.options.verify == copy_engine::Verify::Strict && result.haveChecksum) {
+                fdatasync(out);
+            }
+        } else {
+            report(state, "Copy failed for '" + where + "'");
+        }
+        close(in);
+        close(out);
+        if (ok && state.options.verify != copy_engine::Verify::None && result.haveChecksum) {
+            uint32_t checksum = 0;
+            bool device = state.options.verify == copy_engine::Verify::Strict;
+            if (!copy_engine::reread_checksum(where, checksum, device) || checksum != result.checksum) {
+                error_message_no_halt("Checksum", "Dosent Match!! '" + where + "'");
+                state.errors++;
+                return;
+            }
+        }
+        if (ok) {
+            state.files++;
+            state.bytes += result.bytes;
+            if (state.options.meter) {
+                state.options.meter->add_files();
+            }
+        }
+    }
+
+    struct StripedFile {                                    // finished by whichever stripe ends last
+        CopyState* state;
+        int in;
+        int out;
+        struct stat st;
+        std::string where;
+        std::atomic<bool> failed{false};
+
+        ~StripedFile() {
+            if (!failed) {
+                finish_file(out, st);
+                state->files++;
+                state->bytes += static_cast<std::uintmax_t>(st.st_size);
+                if (state->options.meter) {
+                    state->options.meter->add_files();
+                }
+            } else {
+                error_message_no_halt("cp", "Copy failed for '" + where + "'");
+                state->errors++;
+            }
+            close(in);
+            close(out);
+        }
+    };
+
+    void copy_striped(CopyState& state, walker::Handle source, std::shared_ptr<DestDir> destination, const std::string& name, const struct stat& st, int out) {
+        int in = openat(source->fd, name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            report(state, "Cannot open '" + name + "'");
+            if (out >= 0) close(out);
+            return;
+        }
+        if (out < 0) {
+            out = create_destination(state, *destination, name, st);
+        }
+        if (out < 0) {
+            close(in);
+            return;
+        }
+        auto file = std::make_shared<StripedFile>();
+        file->state = &state;
+        file->in = in;
+        file->out = out;
+        file->st = st;
+        file->where = join_path(destination->path, name);
+        if (ioctl(out, FICLONE, in) == 0) {                 // whole file shared at once, nothing to stripe
+            if (state.options.meter) {
+                state.options.meter->add_bytes(static_cast<std::uintmax_t>(st.st_size));
+            }
+            return;
+        }
+        fallocate(out, FALLOC_FL_KEEP_SIZE, 0, st.st_size);
+        for (off_t offset = 0; offset < st.st_size; offset += STRIPE_SIZE) {
+            off_t length = std::min(STRIPE_SIZE, st.st_size - offset);
+            state.io->submit([file, offset, length] {
+                if (!file->failed && !copy_engine::copy_range(file->in, file->out, offset, length)) {
+                    file->failed = true;
+                } else if (file->state->options.meter) {
+                    file->state->options.meter->add_bytes(static_cast<std::uintmax_t>(length));
+                }
+            });
+        }
+    }
+
+    void flush_batch(CopyState& state, Batch& batch) {
+        if (batch.files.empty()) {
+            return;
+        }
+        auto ready = std::make_shared<Batch>(std::move(batch));
+        batch = Batch();
+        batch.source = ready->source;
+        batch.destination = ready->destination;
+        state.io->submit([&state, ready] { copy_batch(state, *ready); });
+    }
+
+    std::shared_ptr<DestDir> make_directory(CopyState& state, const DestDir& parent, const std::string& name, const struct stat& st, int depth) {
+        std::string path = join_path(parent.path, name);
+        if (mkdirat(parent.handle->fd, name.c_str(), 0700) != 0 && errno != EEXIST) {
+            report(state, "Cannot create directory '" + path + "'");
+            return nullptr;
+        }
+        int fd = openat(parent.handle->fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            report(state, "Cannot open directory '" + path + "'");
+            return nullptr;
+        }
+        auto destination = std::make_shared<DestDir>();
+        destination->handle = std::make_shared<walker::FdHandle>(fd);
+        destination->path = path;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.dirs.push_back({path, static_cast<mode_t>(st.st_mode & 07777), {st.st_atim, st.st_mtim}, depth});
+        state.directories++;
+        return destination;
+    }
+
+    void copy_symlink(CopyState& state, int sourceFd, const DestDir& destination, const std::string& name, const struct stat& st) {
+        std::vector<char> target(static_cast<size_t>(std::max<off_t>(st.st_size, PATH_MAX)) + 1);
+        ssize_t n = readlinkat(sourceFd, name.c_str(), target.data(), target.size() - 1);
+        if (n < 0) {
+            report(state, "Cannot read link '" + name + "'");
+            return;
+        }
+        target[n] = '\0';
+        if (symlinkat(target.data(), destination.handle->fd, name.c_str()) != 0) {
+            if (errno == EEXIST && !state.options.force) {
+                state.skipped++;
+                return;
+            }
+            if (errno != EEXIST || unlinkat(destination.handle->fd, name.c_str(), 0) != 0 ||
+                symlinkat(target.data(), destination.handle->fd, name.c_str()) != 0) {
+                report(state, "Cannot create link '" + join_path(destination.path, name) + "'");
+                return;
+            }
+        }
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        utimensat(destination.handle->fd, name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+        state.symlinks++;
+    }
+
+    void copy_special(CopyState& state, const DestDir& destination, const std::string& name, const struct stat& st) {
+        if (mknodat(destination.handle->fd, name.c_str(), st.st_mode, st.st_rdev) != 0) {
+            if (errno == EEXIST) {
+                state.skipped++;
+                return;
+            }
+            report(state, "Cannot create special file '" + join_path(destination.path, name) + "'");
+            return;
+        }
+        state.files++;
+        if (state.options.meter) {
+            state.options.meter->add_files();
+        }
+    }
+
+    // For files with several links: the first one is created here and copied later, the rest
+    // become hard links to it. Returns true when the entry was handled as a link.
+    bool handle_hardlink(CopyState& state, const DestDir& destination, const std::string& name, const struct stat& st, int& out) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        auto key = std::make_pair(st.st_dev, st.st_ino);
+        auto it = state.links.find(key);
+        if (it == state.links.end()) {
+            out = create_destination(state, destination, name, st);
+            if (out >= 0) {
+                state.links.emplace(key, join_path(destination.path, name));
+            }
+            return out < 0;
+        }
+        int linked = linkat(AT_FDCWD, it->second.c_str(), destination.handle->fd, name.c_str(), 0);
+        if (linked != 0 && errno == EEXIST && state.options.force && unlinkat(destination.handle->fd, name.c_str(), 0) == 0) {
+            linked = linkat(AT_FDCWD, it->second.c_str(), destination.handle->fd, name.c_str(), 0);
+        }
+        if (linked != 0) {
+            if (errno == EEXIST && !state.options.force) {
+                state.skipped++;
+            } else {
+                report(state, "Cannot link '" + join_path(destination.path, name) + "'");
+            }
+            return true;
+        }
+        state.hardlinks++;
+        return true;
+    }
+
+    void visit(CopyState& state, walker::Directory& directory) {
+        auto destination = std::static_pointer_cast<DestDir>(directory.context);
+        int sourceFd = directory.handle->fd;
+        Batch batch;
+        batch.source = directory.handle;
+        batch.destination = destination;
+
+        for (size_t i = 0; i < directory.entries.size(); ++i) {
+            const std::string& name = directory.entries[i].name;
+            struct stat st;
+            if (fstatat(sourceFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                report(state, "Cannot stat '" + directory.child_path(directory.entries[i]) + "'");
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                auto child = make_directory(state, *destination, name, st, directory.depth + 1);
+                if (child) {
+                    directory.descend(i, child);
+                }
+            } else if (S_ISLNK(st.st_mode)) {
+                copy_symlink(state, sourceFd, *destination, name, st);
+            } else if (S_ISREG(st.st_mode)) {
+                int out = -1;
+                if (st.st_nlink > 1 && handle_hardlink(state, *destination, name, st, out)) {
+                    continue;
+                }
+                bool verified = state.options.verify != copy_engine::Verify::None;
+                if (st.st_size <= SMALL_FILE && !verified) {
+                    batch.files.push_back({name, st, out});
+                    batch.bytes += st.st_size;
+                    if (batch.files.size() >= BATCH_FILES || batch.bytes >= BATCH_BYTES) {
+                        flush_batch(state, batch);
+                    }
+                } else if (st.st_size > 2 * STRIPE_SIZE && !verified && st.st_blocks * 512 >= st.st_size) {   // sparse files go whole, holes and all
+                    copy_striped(state, directory.handle, destination, name, st, out);
+                } else {
+                    walker::Handle source = directory.handle;
+                    state.io->submit([&state, source, destination, name, st, out] {
+                        copy_whole(state, source, destination, name, st, out);
+                    });
+                }
+            } else {
+                copy_special(state, *destination, name, st);
+            }
+        }
+        flush_batch(state, batch);
+    }
+
+    bool copy(const std::string& source, const std::string& destination, const Options& options, Stats& stats) {
+        auto start = std::chrono::steady_clock::now();
+        struct stat sourceStat;
+        if (stat(source.c_str(), &sourceStat) != 0 || !S_ISDIR(sourceStat.st_mode)) {
+            error_message_no_halt("cp", "'" + source + "' is not a directory");
+            return false;
+        }
+        std::string target = destination;
+        struct stat destinationStat;
+        if (stat(destination.c_str(), &destinationStat) == 0 && S_ISDIR(destinationStat.st_mode)) {
+            target = join_path(destination, fs::path(source).lexically_normal().filename().string());
+            if (fs::path(source).lexically_normal().filename().empty()) {
+                target = join_path(destination, fs::path(source).lexically_normal().parent_path().filename().string());
+            }
+        }
+
+        std::error_code ec;
+        fs::path sourceReal = fs::canonical(source, ec);
+        fs::path targetParent = fs::weakly_canonical(fs::absolute(target).parent_path(), ec);
+        std::string sourcePrefix = sourceReal.string() + "/";
+        if ((targetParent.string() + "/").compare(0, sourcePrefix.size(), sourcePrefix) == 0 ||
+            targetParent == sourceReal) {
+            error_message_no_halt("cp", "cannot copy '" + source + "' into itself");
+            return false;
+        }
+
+        CopyState state;
+        state.options = options;
+        DestDir parent;
+        parent.path = fs::absolute(target).parent_path().string();
+        int parentFd = open(parent.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (parentFd < 0) {
+            error_message_no_halt("cp", "Cannot open '" + parent.path + "': " + strerror(errno));
+            return false;
+        }
+        parent.handle = std::make_shared<walker::FdHandle>(parentFd);
+        auto root = make_directory(state, parent, fs::absolute(target).filename().string(), sourceStat, 0);
+        if (!root) {
+            return false;
+        }
+
+        unsigned ioThreads = options.ioThreads ? options.ioThreads : std::max(4u, TaskPool::default_threads());
+        bool walked;
+        {
+            TaskPool io(ioThreads, IO_QUEUE);
+            state.io = &io;
+            walked = walker::walk(source, options.walkThreads, [&state](walker::Directory& directory) {
+                visit(state, directory);
+            }, root);
+            root.reset();
+            io.wait();
+        }
+
+        std::sort(state.dirs.begin(), state.dirs.end(), [](const DirFinish& a, const DirFinish& b) {
+            return a.depth > b.depth;                       // children before parents, read-only dirs last
+        });
+        for (const DirFinish& dir : state.dirs) {
+            chmod(dir.path.c_str(), dir.mode);
+            utimensat(AT_FDCWD, dir.path.c_str(), dir.times, 0);
+        }
+
+        stats.files = state.files;
+        stats.bytes = state.bytes;
+        stats.directories = state.directories;
+        stats.symlinks = state.symlinks;
+        stats.hardlinks = state.hardlinks;
+        stats.skipped = state.skipped;
+        stats.errors = state.errors + (walked ? 0 : 1);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return walked && state.errors == 0;
+    }
+}
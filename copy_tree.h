@@ -0,0 +1,34 @@
+#ifndef COPY_TREE_H
+#define COPY_TREE_H
+
+#include <cstdint>
+#include <string>
+
+#include "c_cp.h"
+#include "progress.h"
+
+namespace copy_tree {
+    struct Options {
+        bool force = false;                     // overwrite existing files instead of skipping them
+        copy_engine::Verify verify = copy_engine::Verify::None;
+        unsigned walkThreads = 0;               // directory scanners, 0 = one per core
+        unsigned ioThreads = 0;                 // file copiers, 0 = default
+        progress::Meter* meter = nullptr;       // fed as files complete
+    };
+
+    struct Stats {
+        std::uintmax_t files = 0;
+        std::uintmax_t bytes = 0;
+        std::uintmax_t directories = 0;
+        std::uintmax_t symlinks = 0;
+        std::uintmax_t hardlinks = 0;
+        std::uintmax_t skipped = 0;
+        std::uintmax_t errors = 0;
+        double seconds = 0;
+    };
+
+    // Copies the tree at source to destination (or into it, if it is an existing directory)
+    bool copy(const std::string& source, const std::string& destination, const Options& options, Stats& stats);
+}
+
+#endif // COPY_TREE_H
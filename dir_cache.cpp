@@ -0,0 +1,389 @@
+#include "dir_cache.h"
+#include "base_tools.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace dir_cache {
+    const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+    const size_t SLOT_OVERHEAD = 128;               // map node, LRU node, vector header
+    const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+    struct Key {
+        dev_t dev;
+        ino_t ino;
+        bool operator==(const Key& other) const { return dev == other.dev && ino == other.ino; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<uint64_t>()(static_cast<uint64_t>(key.ino) * 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(key.dev));
+        }
+    };
+
+    struct Slot {
+        Snapshot snapshot;
+        struct timespec mtime;
+        struct timespec ctime;
+        off_t size;
+        int wd;                     // -1 when there is no watch (limit reached, no /proc), mtime/size only
+        bool stale;
+        size_t bytes;
+        std::list<Key>::iterator lru;
+    };
+
+    bool same_time(const struct timespec& a, const struct timespec& b) {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+
+    size_t snapshot_bytes(const std::vector<walker::Entry>& entries) {
+        size_t bytes = SLOT_OVERHEAD + entries.capacity() * sizeof(walker::Entry);
+        for (const auto& entry : entries) {
+            if (entry.name.size() >= sizeof(std::string)) {     // past the small string buffer
+                bytes += entry.name.capacity() + 1;
+            }
+        }
+        return bytes;
+    }
+
+    // One process-wide cache. Callers are the shell thread (ls, completion, globbing), but the lock
+    // keeps it safe for builtins that list from pool workers.
+    class Cache {
+    public:
+        Cache() : inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), bytes(0), capacity(DEFAULT_CAPACITY),
+                  hits(0), misses(0), invalidations(0), evictions(0) {}
+
+        ~Cache() {
+            if (inotifyFd >= 0) {
+                close(inotifyFd);
+            }
+        }
+
+        Snapshot lookup(int dirfd) {
+            struct stat st;
+            if (fstat(dirfd, &st) != 0) {
+                return nullptr;
+            }
+            if (!S_ISDIR(st.st_mode)) {
+                errno = ENOTDIR;
+                return nullptr;
+            }
+            Key key{st.st_dev, st.st_ino};
+
+            std::lock_guard<std::mutex> lock(mutex);
+            drain_events();
+            auto it = slots.find(key);
+            if (it != slots.end()) {
+                Slot& slot = it->second;
+                // inotify catches changes within one timestamp tick, the stat check covers
+                // directories without a watch and changes made from other NFS clients
+                if (!slot.stale && same_time(slot.mtime, st.st_mtim) && same_time(slot.ctime, st.st_ctim) && slot.size == st.st_size) {
+                    ++hits;
+                    lru.splice(lru.begin(), lru, slot.lru);
+                    return slot.snapshot;
+                }
+                ++invalidations;
+            }
+            ++misses;
+
+            // Watch before reading, so a change that lands while we read is queued for the next lookup
+            int wd = it != slots.end() ? it->second.wd : -1;
+            if (wd < 0 && inotifyFd >= 0) {
+                std::string procPath = "/proc/self/fd/" + std::to_string(dirfd);
+                wd = inotify_add_watch(inotifyFd, procPath.c_str(), WATCH_MASK);
+            }
+            if (fstat(dirfd, &st) != 0 || lseek(dirfd, 0, SEEK_SET) < 0) {
+                drop(key, wd);
+                return nullptr;
+            }
+            auto entries = std::make_shared<std::vector<walker::Entry>>();
+            if (!walker::read_entries(dirfd, *entries)) {
+                int error = errno;
+                drop(key, wd);
+                errno = error;
+                return nullptr;
+            }
+            std::sort(entries->begin(), entries->end(), [](const walker::Entry& a, const walker::Entry& b) {
+                return a.name < b.name;
+            });
+
+            Snapshot snapshot = entries;
+            size_t size = snapshot_bytes(*entries);
+            if (size > capacity) {
+                drop(key, wd);                      // would evict everything else, hand it out uncached
+                return snapshot;
+            }
+            if (it == slots.end()) {
+                it = slots.emplace(key, Slot{}).first;
+                lru.push_front(key);
+                it->second.lru = lru.begin();
+                it->second.bytes = 0;
+            } else {
+                lru.splice(lru.begin(), lru, it->second.lru);
+            }
+            Slot& slot = it->second;
+            bytes += size - slot.bytes;
+            slot.snapshot = snapshot;
+            slot.mtime = st.st_mtim;
+            slot.ctime = st.st_ctim;
+            slot.size = st.st_size;
+            slot.wd = wd;
+            slot.stale = false;
+            slot.bytes = size;
+            if (wd >= 0) {
+                watched[wd] = key;
+            }
+            while (bytes > capacity && lru.size() > 1) {
+                drop(lru.back(), slots[lru.back()].wd);
+                ++evictions;
+            }
+            return snapshot;
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            drain_events();
+            return Stats{hits, misses, invalidations, evictions, slots.size(), bytes, capacity, watched.size()};
+        }
+
+        void reset_stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            hits = misses = invalidations = evictions = 0;
+        }
+
+        void set_capacity(size_t newCapacity) {
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity = newCapacity;
+            while (bytes > capacity && !lru.empty()) {
+                drop(lru.back(), slots[lru.back()].wd);
+                ++evictions;
+            }
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!lru.empty()) {
+                drop(lru.back(), slots[lru.back()].wd);
+            }
+        }
+
+    private:
+        // Marks every directory named by a queued event stale; the next lookup rereads it
+        void drain_events() {
+            if (inotifyFd < 0) {
+                return;
+            }
+            alignas(struct inotify_event) char buffer[16 * 1024];
+            while (true) {
+                ssize_t n = read(inotifyFd, buffer, sizeof(buffer));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) continue;
+                    return;                         // EAGAIN: queue is empty
+                }
+                for (ssize_t offset = 0; offset < n;) {
+                    auto* event = reinterpret_cast<struct inotify_event*>(buffer + offset);
+                    offset += sizeof(struct inotify_event) + event->len;
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        for (auto& pair : slots) {
+                            pair.second.stale = true;   // lost events, trust nothing
+                        }
+                        continue;
+                    }
+                    auto watch = watched.find(event->wd);
+                    if (watch == watched.end()) {
+                        continue;                   // IN_IGNORED after we removed it ourselves
+                    }
+                    auto it = slots.find(watch->second);
+                    if (it != slots.end()) {
+                        it->second.stale = true;
+                        if (event->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+                            it->second.wd = -1;     // the kernel dropped the watch with the directory
+                        }
+                    }
+                    if (event->mask & IN_IGNORED) {
+                        watched.erase(watch);
+                    }
+                }
+            }
+        }
+
+        void drop(Key key, int wd) {
+            if (wd >= 0) {
+                inotify_rm_watch(inotifyFd, wd);
+                watched.erase(wd);
+            }
+            auto it = slots.find(key);
+            if (it != slots.end()) {
+                bytes -= it->second.bytes;
+                lru.erase(it->second.lru);
+                slots.erase(it);
+            }
+        }
+
+        int inotifyFd;
+        std::mutex mutex;
+        std::unordered_map<Key, Slot, KeyHash> slots;
+        std::unordered_map<int, Key> watched;
+        std::list<Key> lru;                         // most recently used first
+        size_t bytes;
+        size_t capacity;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;
+        uint64_t evictions;
+    };
+
+    Cache& cache() {
+        static Cache instance;
+        return instance;
+    }
+
+    Snapshot lookup(int dirfd) {
+        return cache().lookup(dirfd);
+    }
+
+    Snapshot lookup(const std::string& path) {
+        int dirfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd < 0) {
+            return nullptr;
+        }
+        Snapshot snapshot = cache().lookup(dirfd);
+        int error = errno;
+        close(dirfd);
+        errno = error;
+        return snapshot;
+    }
+
+    Stats stats() {
+        return cache().stats();
+    }
+
+    void reset_stats() {
+        cache().reset_stats();
+    }
+
+    void set_capacity(size_t bytes) {
+        cache().set_capacity(bytes);
+    }
+
+    void clear() {
+        cache().clear();
+    }
+
+    bool has_wildcards(const std::string& word) {
+        return word.find_first_of("*?[") != std::string::npos;
+    }
+
+    bool is_directory(const std::string& path, unsigned char type) {
+        if (type == DT_DIR) {
+            return true;
+        }
+        struct stat st;
+        return (type == DT_LNK || type == DT_UNKNOWN) && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    void expand(const std::string& base, const std::vector<std::string>& parts, size_t index, bool trailingSlash,
+                std::vector<std::string>& matches) {
+        bool last = index + 1 == parts.size();
+        const std::string& part = parts[index];
+        if (!has_wildcards(part)) {
+            std::string path = base + part;
+            if (!last) {
+                expand(path + "/", parts, index + 1, trailingSlash, matches);
+                return;
+            }
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0 && (!trailingSlash || is_directory(path, DT_UNKNOWN))) {
+                matches.push_back(trailingSlash ? path + "/" : path);
+            }
+            return;
+        }
+
+        Snapshot snapshot = lookup(base.empty() ? std::string(".") : base);
+        if (!snapshot) {
+            return;
+        }
+        for (const auto& entry : *snapshot) {
+            if (entry.name[0] == '.' && part[0] != '.') {
+                continue;
+            }
+            if (fnmatch(part.c_str(), entry.name.c_str(), FNM_PERIOD) != 0) {
+                continue;
+            }
+            std::string path = base + entry.name;
+            if (last && !trailingSlash) {
+                matches.push_back(path);
+            } else if (is_directory(path, entry.type)) {
+                if (last) {
+                    matches.push_back(path + "/");
+                } else {
+                    expand(path + "/", parts, index + 1, trailingSlash, matches);
+                }
+            }
+        }
+    }
+
+    bool glob(const std::string& pattern, std::vector<std::string>& matches) {
+        std::string base = pattern[0] == '/' ? "/" : "";
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start < pattern.size()) {
+            size_t slash = pattern.find('/', start);
+            if (slash == std::string::npos) slash = pattern.size();
+            if (slash > start) {
+                parts.push_back(pattern.substr(start, slash - start));
+            }
+            start = slash + 1;
+        }
+        if (parts.empty()) {
+            return false;
+        }
+        size_t before = matches.size();
+        expand(base, parts, 0, pattern.back() == '/', matches);
+        std::sort(matches.begin() + before, matches.end());
+        return matches.size() > before;
+    }
+}
+
+void c_stats(const std::vector<std::string>& args) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-r") {
+            dir_cache::reset_stats();
+            return;
+        } else if (args[i] == "--clear") {
+            dir_cache::clear();
+            return;
+        } else if (args[i] == "--cap" && i + 1 < args.size()) {
+            dir_cache::set_capacity(static_cast<size_t>(std::max(1, stringToInt(args[++i]))) * 1024 * 1024);
+            return;
+        } else {
+            std::cout << "Usage: stats [-r] [--clear] [--cap <MiB>]\n"
+                         "       -r           reset the counters\n"
+                         "       --clear      drop every cached directory listing\n"
+                         "       --cap <MiB>  memory cap for the directory listing cache\n";
+            return;
+        }
+    }
+
+    dir_cache::Stats stats = dir_cache::stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    double hitRate = lookups > 0 ? 100.0 * static_cast<double>(stats.hits) / static_cast<double>(lookups) : 0.0;
+    char line[256];
+    snprintf(line, sizeof(line),
+             "dir_cache: hits=%ju misses=%ju hit_rate=%.1f%% invalidations=%ju evictions=%ju directories=%zu watches=%zu",
+             static_cast<uintmax_t>(stats.hits), static_cast<uintmax_t>(stats.misses), hitRate,
+             static_cast<uintmax_t>(stats.invalidations), static_cast<uintmax_t>(stats.evictions),
+             stats.directories, stats.watches);
+    std::cout << line << " memory=" << formatBytes(stats.bytes) << " cap=" << formatBytes(stats.capacity) << "\n";
+}
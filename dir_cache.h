@@ -0,0 +1,48 @@
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include "walker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dir_cache {
+    // Every entry of a directory, hidden ones included, sorted by name. Shared with the cache,
+    // so it stays valid even if the directory is invalidated or evicted while in use.
+    using Snapshot = std::shared_ptr<const std::vector<walker::Entry>>;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;     // snapshots found stale by inotify or by the mtime/size check
+        uint64_t evictions;         // dropped to stay under the memory cap
+        size_t directories;
+        size_t bytes;
+        size_t capacity;
+        size_t watches;             // directories with a live inotify watch
+    };
+
+    // Listing of the open directory dirfd, served from memory while the directory is unchanged.
+    // Snapshots are keyed by (st_dev, st_ino) so every path to a directory shares one. Returns
+    // nullptr with errno set if the directory cannot be read.
+    Snapshot lookup(int dirfd);
+    Snapshot lookup(const std::string& path);
+
+    Stats stats();
+    void reset_stats();
+    void set_capacity(size_t bytes);
+    void clear();
+
+    // Expands a shell wildcard word ('*', '?', '[...]' in any path component) against the cached
+    // listings. Names starting with '.' only match a pattern that starts with '.'. Returns false
+    // when nothing matched.
+    bool glob(const std::string& pattern, std::vector<std::string>& matches);
+    bool has_wildcards(const std::string& word);
+}
+
+void c_stats(const std::vector<std::string>& args);
+
+#endif // DIR_CACHE_H
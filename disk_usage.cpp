@@ -0,0 +1,251 @@
+#include "disk_usage.h"
+#include "base_tools.h"
+#include "progress.h"
+#include "walker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace disk_usage {
+    const size_t LINK_SHARDS = 64;
+    const unsigned ENTRY_MASK = STATX_TYPE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_BLOCKS;
+
+    struct Node {                           // filled in by the one worker that visits the directory
+        std::string name;
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        uint64_t hardlinks = 0;
+        bool failed = false;
+        bool seen = false;                  // reached before, from another root: not counted again
+        std::vector<std::shared_ptr<Node>> children;      // the same nodes the walker passes to their visits
+    };
+
+    struct InodeHash {
+        size_t operator()(const std::pair<dev_t, ino_t>& key) const {
+            return std::hash<uint64_t>()(static_cast<uint64_t>(key.second) * 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(key.first));
+        }
+    };
+
+    // Only inodes with more than one name go in here, so the shard locks are rarely taken
+    class LinkSet {
+    public:
+        bool first_sighting(dev_t dev, ino_t ino) {
+            std::pair<dev_t, ino_t> key(dev, ino);
+            Shard& shard = shards[InodeHash()(key) % LINK_SHARDS];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            return shard.seen.insert(key).second;
+        }
+
+    private:
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_set<std::pair<dev_t, ino_t>, InodeHash> seen;
+        };
+        Shard shards[LINK_SHARDS];
+    };
+
+    struct MeasureState {                   // one for all roots, so "du D D/a" counts D/a once
+        const Options* options;
+        dev_t rootDevice;
+        LinkSet links;
+        LinkSet directories;
+        progress::Meter* meter;
+    };
+
+    uint64_t charge(const Options& options, uint64_t size, uint64_t blocks) {
+        return options.apparent ? size : blocks * 512;
+    }
+
+    void visit(MeasureState& state, walker::Directory& directory) {
+        const Options& options = *state.options;
+        Node& node = *std::static_pointer_cast<Node>(directory.context);
+        int dirfd = directory.handle->fd;
+
+        struct stat self;
+        if (fstat(dirfd, &self) == 0) {
+            if (!state.directories.first_sighting(self.st_dev, self.st_ino)) {
+                node.seen = true;
+                return;
+            }
+            node.bytes += charge(options, static_cast<uint64_t>(self.st_size), static_cast<uint64_t>(self.st_blocks));
+        }
+
+        uint64_t files = 0;
+        for (size_t i = 0; i < directory.entries.size(); ++i) {
+            walker::Entry& entry = directory.entries[i];
+            unsigned char type = walker::resolve_type(dirfd, entry);
+            if (type == DT_DIR) {
+                if (options.oneFilesystem) {
+                    struct stat st;
+                    if (fstatat(dirfd, entry.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 || st.st_dev != state.rootDevice) {
+                        continue;
+                    }
+                }
+                auto child = std::make_shared<Node>();
+                child->name = entry.name;
+                node.children.push_back(child);
+                directory.descend(i, child);
+                continue;
+            }
+
+            struct statx stx;
+            if (statx(dirfd, entry.name.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, ENTRY_MASK, &stx) != 0) {
+                node.failed = true;
+                continue;
+            }
+            if (stx.stx_nlink > 1 && !state.links.first_sighting(makedev(stx.stx_dev_major, stx.stx_dev_minor), stx.stx_ino)) {
+                ++node.hardlinks;
+                continue;
+            }
+            uint64_t bytes = charge(options, stx.stx_size, stx.stx_blocks);
+            node.bytes += bytes;
+            ++files;
+            if (state.meter) state.meter->add_bytes(bytes);
+        }
+        node.files += files;
+        if (state.meter) state.meter->add_files(files);
+    }
+
+    void collect(const Node& node, const std::string& path, int depth, const Options& options,
+                 std::vector<Usage>& directories, Totals& totals, uint64_t& bytes, uint64_t& files) {
+        bytes = 0;
+        files = 0;
+        if (node.seen) {
+            return;
+        }
+        bytes = node.bytes;
+        files = node.files;
+        totals.directories += 1;
+        totals.hardlinks += node.hardlinks;
+        totals.errors += node.failed ? 1 : 0;
+
+        std::vector<const Node*> children;
+        children.reserve(node.children.size());
+        for (const auto& child : node.children) {
+            children.push_back(child.get());
+        }
+        std::sort(children.begin(), children.end(), [](const Node* a, const Node* b) { return a->name < b->name; });
+        for (const Node* child : children) {
+            uint64_t childBytes = 0;
+            uint64_t childFiles = 0;
+            std::string childPath = path.back() == '/' ? path + child->name : path + "/" + child->name;
+            collect(*child, childPath, depth + 1, options, directories, totals, childBytes, childFiles);
+            bytes += childBytes;
+            files += childFiles;
+        }
+        if (options.maxDepth < 0 || depth <= options.maxDepth) {
+            directories.push_back(Usage{path, depth, bytes, files});
+        }
+    }
+
+    bool measure(const std::vector<std::string>& roots, const Options& options, std::vector<Usage>& directories,
+                 Totals& totals, progress::Meter* meter) {
+        MeasureState state;
+        state.options = &options;
+        state.meter = meter;
+        bool ok = true;
+        for (const std::string& root : roots) {
+            struct stat rootStat;
+            if (stat(root.c_str(), &rootStat) != 0) {
+                error_message_no_halt("du", "cannot access '" + root + "': " + strerror(errno));
+                ok = false;
+                continue;
+            }
+            uint64_t errorsBefore = totals.errors;
+            state.rootDevice = rootStat.st_dev;
+
+            auto rootNode = std::make_shared<Node>();
+            bool walked = walker::walk(root, options.threads, [&state](walker::Directory& directory) {
+                visit(state, directory);
+            }, rootNode);
+
+            uint64_t bytes = 0;
+            uint64_t files = 0;
+            collect(*rootNode, root, 0, options, directories, totals, bytes, files);
+            totals.bytes += bytes;
+            totals.files += files;
+            ok &= walked && totals.errors == errorsBefore;
+        }
+        return ok;
+    }
+}
+
+void du(const std::vector<std::string>& args) {
+    disk_usage::Options options;
+    bool human = false;
+    size_t top = 0;
+    std::vector<std::string> roots;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "-d" && hasValue) {
+            options.maxDepth = std::max(0, stringToInt(args[++i]));
+        } else if (arg == "-s") {
+            options.maxDepth = 0;
+        } else if (arg == "-n" && hasValue) {
+            top = static_cast<size_t>(std::max(1, stringToInt(args[++i])));
+        } else if (arg == "-j" && hasValue) {
+            options.threads = static_cast<unsigned>(std::max(1, stringToInt(args[++i])));
+        } else if (arg == "-h") {
+            human = true;
+        } else if (arg == "-b") {
+            options.apparent = true;
+        } else if (arg == "-x") {
+            options.oneFilesystem = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cout << "Usage: du [-h] [-b] [-x] [-s | -d <N>] [-n <N>] [-j <N>] [directories...]\n"
+                         "       -h      human readable sizes, otherwise KiB (bytes with -b)\n"
+                         "       -b      apparent size (bytes in the files) instead of disk usage\n"
+                         "       -x      stay on the file system of each directory\n"
+                         "       -s      only the total of each directory, same as -d 0\n"
+                         "       -d <N>  print directories at most N levels down\n"
+                         "       -n <N>  only the N largest directories, largest first\n"
+                         "       -j <N>  walker threads\n";
+            return;
+        } else {
+            roots.push_back(arg);
+        }
+    }
+    if (roots.empty()) {
+        roots.push_back(".");
+    }
+
+    // Nothing is printed until the walk is over, so the status line can use the terminal
+    progress::Meter meter("du");
+    std::vector<disk_usage::Usage> directories;
+    disk_usage::Totals totals;
+    disk_usage::measure(roots, options, directories, totals, &meter);
+
+    if (top > 0) {
+        size_t count = std::min(top, directories.size());
+        std::partial_sort(directories.begin(), directories.begin() + count, directories.end(),
+                          [](const disk_usage::Usage& a, const disk_usage::Usage& b) { return a.bytes > b.bytes; });
+        directories.resize(count);
+    }
+    std::string out;
+    for (const disk_usage::Usage& usage : directories) {
+        if (human) {
+            out += formatBytes(usage.bytes);
+        } else {
+            out += std::to_string(options.apparent ? usage.bytes : (usage.bytes + 1023) / 1024);      // du -b prints bytes
+        }
+        out += '\t';
+        out += usage.path;
+        out += '\n';
+    }
+    meter.finish({{"directories", std::to_string(totals.directories)},
+                  {"hardlinks", std::to_string(totals.hardlinks)},
+                  {"errors", std::to_string(totals.errors)}});
+    std::cout.flush();
+    write_all(STDOUT_FILENO, out);
+}
@@ -0,0 +1,44 @@
+#ifndef DISK_USAGE_H
+#define DISK_USAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace progress { class Meter; }
+
+namespace disk_usage {
+    struct Options {
+        unsigned threads = 0;
+        bool apparent = false;              // st_size instead of allocated blocks
+        bool oneFilesystem = false;         // do not cross mount points
+        int maxDepth = -1;                  // deepest directory reported, the walk always goes all the way
+    };
+
+    struct Usage {                          // one directory, everything below it included
+        std::string path;
+        int depth;                          // root is 0
+        uint64_t bytes;
+        uint64_t files;
+    };
+
+    struct Totals {
+        uint64_t bytes = 0;
+        uint64_t files = 0;
+        uint64_t directories = 0;
+        uint64_t hardlinks = 0;             // extra names of an inode already counted
+        uint64_t errors = 0;
+    };
+
+    // Sums usage bottom-up on several threads. Every directory keeps its own counters, written only
+    // by the worker that reads it, and the sums are folded into the parents once the walk is done.
+    // An inode with several names is counted once, across all roots; so is a directory, which is
+    // left out where it is reached again. directories comes out root by root, children before
+    // parents, siblings by name, like du prints them.
+    bool measure(const std::vector<std::string>& roots, const Options& options, std::vector<Usage>& directories,
+                 Totals& totals, progress::Meter* meter = nullptr);
+}
+
+void du(const std::vector<std::string>& args);
+
+#endif // DISK_USAGE_H
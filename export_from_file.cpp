@@ -93,10 +93,9 @@ void eff(const vector<string> &args)
         }
         content.erase(content.find_last_not_of(" \t\n") + 1);
         tools::create_file(backup_file);
-        c_cp(args[1], backup_file, true);
-        
-        /* if checksums dosent match */
-        if (!Checksum(args[1], backup_file))
+
+        /* verified while copying, fails if checksums dosent match */
+        if (!copyFile(args[1], backup_file, copy_engine::Verify::Strict))
         {
             return;
         }
@@ -0,0 +1,489 @@
+#include "finder.h"
+#include "base_tools.h"
+#include "progress.h"
+#include "walker.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace finder {
+    const size_t FLUSH_BYTES = 64 * 1024;
+
+    struct IgnoreRule {
+        std::string pattern;
+        bool negate;                // "!pattern" re-includes
+        bool directoryOnly;         // "pattern/"
+        bool anchored;              // contains a slash, matched against the path below the .gitignore
+    };
+
+    struct IgnoreScope {            // the rules of one .gitignore, chained to those above it
+        std::shared_ptr<const IgnoreScope> parent;
+        std::string base;           // directory of the .gitignore, relative to the root
+        std::vector<IgnoreRule> rules;
+    };
+
+    struct Node;
+
+    struct Item {                   // sorted mode: one entry that matched, was entered, or both
+        std::string line;
+        std::unique_ptr<Node> child;
+    };
+
+    struct Node {
+        std::vector<Item> items;
+    };
+
+    struct Context {                // what a directory inherits from its parent
+        std::shared_ptr<const IgnoreScope> scope;
+        std::string relative;
+        Node* node = nullptr;
+    };
+
+    struct SearchState {
+        const Options* options;
+        progress::Meter* meter;
+        OutputBuffer output;
+    };
+
+    bool parse_rule(std::string line, IgnoreRule& rule) {
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            return false;
+        }
+        rule.negate = line[0] == '!';
+        if (rule.negate || (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#'))) {
+            line.erase(0, 1);
+        }
+        rule.directoryOnly = !line.empty() && line.back() == '/';
+        while (!line.empty() && line.back() == '/') {
+            line.pop_back();
+        }
+        if (line.compare(0, 3, "**/") == 0 && line.find('/', 3) == std::string::npos) {
+            line.erase(0, 3);                               // "**/name" is the same as "name"
+        }
+        rule.anchored = line.find('/') != std::string::npos;
+        if (!line.empty() && line[0] == '/') {
+            line.erase(0, 1);
+        }
+        rule.pattern = line;
+        return !line.empty();
+    }
+
+    std::vector<IgnoreRule> read_gitignore(int dirfd) {
+        std::vector<IgnoreRule> rules;
+        int fd = openat(dirfd, ".gitignore", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return rules;
+        }
+        std::string text;
+        char buffer[8192];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            text.append(buffer, static_cast<size_t>(n));
+        }
+        close(fd);
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) end = text.size();
+            IgnoreRule rule;
+            if (parse_rule(text.substr(start, end - start), rule)) {
+                rules.push_back(std::move(rule));
+            }
+            start = end + 1;
+        }
+        return rules;
+    }
+
+    bool rule_matches(const IgnoreRule& rule, const std::string& base, const std::string& relative, const std::string& name, bool isDirectory) {
+        if (rule.directoryOnly && !isDirectory) {
+            return false;
+        }
+        if (!rule.anchored) {
+            return fnmatch(rule.pattern.c_str(), name.c_str(), 0) == 0;
+        }
+        const char* below = relative.c_str();
+        if (!base.empty()) {
+            if (relative.compare(0, base.size(), base) != 0 || relative[base.size()] != '/') {
+                return false;
+            }
+            below += base.size() + 1;
+        }
+        // fnmatch has no "**"; without FNM_PATHNAME a '*' crosses directories, which is close enough
+        int flags = rule.pattern.find("**") == std::string::npos ? FNM_PATHNAME : 0;
+        return fnmatch(rule.pattern.c_str(), below, flags) == 0;
+    }
+
+    // Later rules win over earlier ones, deeper .gitignore files over those above them
+    bool ignored(const IgnoreScope* scope, const std::string& relative, const std::string& name, bool isDirectory) {
+        std::vector<const IgnoreScope*> chain;
+        for (; scope; scope = scope->parent.get()) {
+            chain.push_back(scope);
+        }
+        bool result = false;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            for (const IgnoreRule& rule : (*it)->rules) {
+                if (rule_matches(rule, (*it)->base, relative, name, isDirectory)) {
+                    result = !rule.negate;
+                }
+            }
+        }
+        return result;
+    }
+
+    void visit(SearchState& state, walker::Directory& directory) {
+        const Options& options = *state.options;
+        auto context = std::static_pointer_cast<Context>(directory.context);
+        int dirfd = directory.handle->fd;
+
+        std::shared_ptr<const IgnoreScope> scope = context->scope;
+        if (options.gitignore) {
+            std::vector<IgnoreRule> rules = read_gitignore(dirfd);
+            if (!rules.empty()) {
+                scope = std::make_shared<IgnoreScope>(IgnoreScope{scope, context->relative, std::move(rules)});
+            }
+        }
+        if (options.sorted) {
+            std::sort(directory.entries.begin(), directory.entries.end(), [](const walker::Entry& a, const walker::Entry& b) {
+                return a.name < b.name;
+            });
+        }
+
+        int depth = directory.depth + 1;
+        bool enter = options.maxDepth < 0 || depth < options.maxDepth;
+        bool report = depth >= options.minDepth;
+        std::string batch;
+        for (size_t i = 0; i < directory.entries.size(); ++i) {
+            walker::Entry& entry = directory.entries[i];
+            if (!options.hidden && entry.name[0] == '.') {
+                continue;
+            }
+            unsigned char type = walker::resolve_type(dirfd, entry);
+            bool isDirectory = type == DT_DIR;
+            if (options.gitignore && isDirectory && entry.name == ".git") {
+                continue;
+            }
+            std::string relative = context->relative.empty() ? entry.name : context->relative + "/" + entry.name;
+            if (scope && ignored(scope.get(), relative, entry.name, isDirectory)) {
+                continue;
+            }
+
+            predicate::Candidate candidate(dirfd, directory.path, entry.name, type);
+            bool matched = report && (options.filter.empty() || options.filter.matches(candidate));
+            bool descend = isDirectory && enter;
+            if (!matched && !descend) {
+                continue;
+            }
+            std::string line;
+            if (matched) {
+                line = candidate.path();
+                line += options.separator;
+                if (state.meter) state.meter->add_files();
+            }
+            Item* item = nullptr;
+            if (options.sorted) {
+                context->node->items.push_back(Item{std::move(line), nullptr});
+                item = &context->node->items.back();
+            } else {
+                batch += line;
+            }
+            if (descend) {
+                auto child = std::make_shared<Context>();
+                child->scope = scope;
+                child->relative = std::move(relative);
+                if (item) {
+                    item->child = std::make_unique<Node>();
+                    child->node = item->child.get();
+                }
+                directory.descend(i, child);
+            }
+        }
+        if (!batch.empty()) {
+            state.output.emit(batch);
+        }
+    }
+
+    void emit_sorted(const Node& node, std::string& out, OutputBuffer& output) {
+        for (const Item& item : node.items) {
+            out += item.line;
+            if (out.size() >= FLUSH_BYTES) {
+                output.emit(out);
+                out.clear();
+            }
+            if (item.child) {
+                emit_sorted(*item.child, out, output);
+            }
+        }
+    }
+
+    bool search(const std::string& root, const Options& options, progress::Meter* meter) {
+        SearchState state;
+        state.options = &options;
+        state.meter = meter;
+
+        auto rootContext = std::make_shared<Context>();
+        if (!options.excludes.empty()) {
+            auto scope = std::make_shared<IgnoreScope>();
+            for (const std::string& pattern : options.excludes) {
+                IgnoreRule rule;
+                if (parse_rule(pattern, rule)) {
+                    scope->rules.push_back(std::move(rule));
+                }
+            }
+            rootContext->scope = scope;
+        }
+        Node rootNode;
+        rootContext->node = &rootNode;
+
+        std::cout.flush();                                  // keep ordering with anything already buffered
+        std::string rootLine;
+        if (options.includeRoot && options.minDepth == 0) {
+            walker::Entry entry{root, DT_UNKNOWN, 0};
+            predicate::Candidate candidate(AT_FDCWD, std::string(), entry.name, walker::resolve_type(AT_FDCWD, entry));
+            if (candidate.status() && (options.filter.empty() || options.filter.matches(candidate))) {
+                rootLine = root + options.separator;
+                if (meter) meter->add_files();
+            }
+        }
+        if (!options.sorted) {
+            state.output.emit(rootLine);
+        }
+
+        bool walked = true;
+        if (options.maxDepth != 0) {
+            walked = walker::walk(root, options.threads, [&state](walker::Directory& directory) {
+                visit(state, directory);
+            }, rootContext);
+        }
+        rootContext.reset();
+
+        if (options.sorted) {
+            std::string out = rootLine;
+            emit_sorted(rootNode, out, state.output);
+            state.output.emit(out);
+        }
+        state.output.flush();
+        return walked;
+    }
+
+    bool parse_number(const std::string& text, size_t start, int64_t& number, char& unit) {
+        size_t end = start;
+        while (end < text.size() && isdigit(static_cast<unsigned char>(text[end]))) {
+            ++end;
+        }
+        if (end == start || end - start > 18 || end + 1 < text.size()) {
+            return false;
+        }
+        number = std::stoll(text.substr(start, end - start));
+        unit = end < text.size() ? text[end] : '\0';
+        return true;
+    }
+
+    bool parse_size(const std::string& text, predicate::Expression& expression) {
+        int64_t number;
+        char unit;
+        if (text.size() < 2 || (text[0] != '+' && text[0] != '-') || !parse_number(text, 1, number, unit)) {
+            return false;
+        }
+        int shift;
+        switch (unit) {
+            case '\0': case 'b': shift = 0; break;
+            case 'k': case 'K': shift = 10; break;
+            case 'M': shift = 20; break;
+            case 'G': shift = 30; break;
+            case 'T': shift = 40; break;
+            default: return false;
+        }
+        if (number > (INT64_MAX >> shift)) {
+            return false;
+        }
+        number <<= shift;
+        expression = predicate::size(text[0] == '+' ? 1 : -1, number);
+        return true;
+    }
+
+    bool parse_age(const std::string& text, predicate::Expression& expression) {
+        int64_t number;
+        char unit;
+        if (text.size() < 2 || (text[0] != '+' && text[0] != '-') || !parse_number(text, 1, number, unit)) {
+            return false;
+        }
+        int64_t seconds;
+        switch (unit) {
+            case 's': seconds = 1; break;
+            case 'm': seconds = 60; break;
+            case 'h': seconds = 3600; break;
+            case '\0': case 'd': seconds = 86400; break;
+            case 'w': seconds = 7 * 86400; break;
+            default: return false;
+        }
+        if (number > INT64_MAX / seconds) {
+            return false;
+        }
+        number *= seconds;
+        expression = predicate::age(text[0] == '+' ? 1 : -1, number);      // in seconds: -2d is younger than two days
+        return true;
+    }
+}
+
+void listFiles(const std::vector<std::string>& args) {
+    finder::Options options;
+    std::string root;
+    std::vector<predicate::Expression> names;
+    std::vector<predicate::Expression> extensions;
+    std::vector<predicate::Expression> tests;           // all of these, plus one of each group above
+    unsigned types = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "-n" && hasValue) {
+            names.push_back(predicate::name(args[++i]));
+        } else if (arg == "-e" && hasValue) {
+            std::string extension = args[++i];
+            extensions.push_back(predicate::extension(extension[0] == '.' ? extension.substr(1) : extension));
+        } else if (arg == "-t" && hasValue) {
+            for (char type : args[++i]) {
+                switch (type) {
+                    case 'f': types |= predicate::TYPE_FILE; break;
+                    case 'd': types |= predicate::TYPE_DIRECTORY; break;
+                    case 'l': types |= predicate::TYPE_SYMLINK; break;
+                    case 'o': types |= predicate::TYPE_OTHER; break;
+                    default:
+                        error_message_no_halt("lf", std::string("unknown type '") + type + "' (f, d, l, o)");
+                        return;
+                }
+            }
+        } else if (arg == "-s" && hasValue) {
+            tests.emplace_back();
+            if (!finder::parse_size(args[++i], tests.back())) {
+                error_message_no_halt("lf", "size must look like +10M or -4k, not '" + args[i] + "'");
+                return;
+            }
+        } else if (arg == "-m" && hasValue) {
+            tests.emplace_back();
+            if (!finder::parse_age(args[++i], tests.back())) {
+                error_message_no_halt("lf", "age must look like -2d (within) or +1w (before), not '" + args[i] + "'");
+                return;
+            }
+        } else if (arg == "-E" && hasValue) {
+            options.excludes.push_back(args[++i]);
+        } else if (arg == "-d" && hasValue) {
+            options.maxDepth = std::max(1, stringToInt(args[++i]));
+        } else if (arg == "-j" && hasValue) {
+            options.threads = static_cast<unsigned>(std::max(1, stringToInt(args[++i])));
+        } else if (arg == "-g") {
+            options.gitignore = true;
+        } else if (arg == "-H") {
+            options.hidden = false;
+        } else if (arg == "-S") {
+            options.sorted = true;
+        } else if (arg == "-0") {
+            options.separator = '\0';
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cout << "Usage: lf [options] [directory]\n"
+                         "       -n <glob>     name matches the glob (repeatable)\n"
+                         "       -e <ext>      extension (repeatable)\n"
+                         "       -t <fdlo>     type: file, directory, symlink, other\n"
+                         "       -s <+N|-N>    larger / smaller than N bytes, k M G T suffixes\n"
+                         "       -m <-N|+N>    modified within / before N, s m h d w suffixes\n"
+                         "       -E <pattern>  exclude, .gitignore syntax (repeatable)\n"
+                         "       -g            honour .gitignore files and skip .git\n"
+                         "       -H            skip hidden entries\n"
+                         "       -d <N>        descend at most N levels\n"
+                         "       -S            sorted output\n"
+                         "       -0            separate paths with NUL\n"
+                         "       -j <N>        walker threads\n";
+            return;
+        } else {
+            root += (root.empty() ? "" : " ") + arg;
+        }
+    }
+
+    if (types) {
+        tests.push_back(predicate::type(types));
+    }
+    if (!names.empty()) {
+        tests.push_back(predicate::any(std::move(names)));
+    }
+    if (!extensions.empty()) {
+        tests.push_back(predicate::any(std::move(extensions)));
+    }
+    options.filter = predicate::Program(predicate::all(std::move(tests)));
+
+    // The listing itself goes to stdout, so only draw a status line when that is redirected
+    progress::Meter meter("lf", isatty(STDOUT_FILENO) ? progress::Render::Never : progress::Render::Auto);
+    finder::search(root.empty() ? "." : root, options, &meter);
+    meter.finish();
+}
+
+void c_find(const std::vector<std::string>& args) {
+    finder::Options options;
+    options.includeRoot = true;
+    std::vector<std::string> roots;
+    std::vector<std::string> words;
+    bool inExpression = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        // Options may appear anywhere, as with GNU find; they are not part of the expression
+        if (arg == "-maxdepth" && hasValue) {
+            options.maxDepth = std::max(0, stringToInt(args[++i]));
+        } else if (arg == "-mindepth" && hasValue) {
+            options.minDepth = std::max(0, stringToInt(args[++i]));
+        } else if (arg == "-j" && hasValue) {
+            options.threads = static_cast<unsigned>(std::max(1, stringToInt(args[++i])));
+        } else if (arg == "-sorted") {
+            options.sorted = true;
+        } else if (arg == "-print0") {
+            options.separator = '\0';
+        } else if (arg == "-print") {
+            continue;                                       // the only action there is
+        } else if (arg == "--help") {
+            std::cout << "Usage: find [paths...] [options] [expression]\n"
+                         "       options:  -maxdepth N  -mindepth N  -j N  -sorted  -print0\n"
+                         "       tests:    -name GLOB  -iname GLOB  -regex RE  -iregex RE  -type [fdlpscb]\n"
+                         "                 -size [+-]N[cwbkMG]  -mtime [+-]N  -mmin [+-]N  -newer FILE\n"
+                         "                 -perm [-/]OCTAL\n"
+                         "       operators: ( EXPR )  ! EXPR  -not EXPR  EXPR -a EXPR  EXPR -o EXPR\n";
+            return;
+        } else if (!inExpression && !arg.empty() && arg[0] != '-' && arg != "(" && arg != "\\(" && arg != ")" && arg != "\\)" && arg != "!") {
+            roots.push_back(arg);
+        } else {
+            inExpression = true;
+            words.push_back(arg);
+        }
+    }
+    if (roots.empty()) {
+        roots.push_back(".");
+    }
+
+    size_t position = 0;
+    predicate::Expression expression;
+    std::string error;
+    if (!predicate::parse(words, position, expression, error)) {
+        error_message_no_halt("find", error);
+        return;
+    }
+    if (position < words.size()) {
+        error_message_no_halt("find", "unknown predicate '" + words[position] + "'");
+        return;
+    }
+    options.filter = predicate::Program(expression);
+
+    progress::Meter meter("find", isatty(STDOUT_FILENO) ? progress::Render::Never : progress::Render::Auto);
+    for (const std::string& root : roots) {
+        finder::search(root, options, &meter);
+    }
+    meter.finish();
+}
@@ -0,0 +1,38 @@
+#ifndef FINDER_H
+#define FINDER_H
+
+#include "predicate.h"
+
+#include <string>
+#include <vector>
+
+namespace progress { class Meter; }
+
+namespace finder {
+    struct Options {
+        predicate::Program filter;              // empty matches everything
+        std::vector<std::string> excludes;      // .gitignore syntax, relative to the root
+        bool gitignore = false;                 // also read .gitignore files and skip .git
+        bool hidden = true;
+        bool includeRoot = false;               // test the root itself too, as find does
+        int minDepth = 0;                       // entries of the root are depth 1
+        int maxDepth = -1;
+        bool sorted = false;                    // deterministic depth first order, by name
+        char separator = '\n';
+        unsigned threads = 0;
+    };
+
+    // Walks root on several threads and writes the path of every matching entry to stdout.
+    // Unsorted output is written in batches as directories finish; sorted output is merged
+    // once the walk is done. Returns false if a directory could not be read.
+    bool search(const std::string& root, const Options& options, progress::Meter* meter = nullptr);
+
+    // "+10M" / "-4k" size bounds and "-2d" (within) / "+1w" (before) age bounds
+    bool parse_size(const std::string& text, predicate::Expression& expression);
+    bool parse_age(const std::string& text, predicate::Expression& expression);
+}
+
+void listFiles(const std::vector<std::string>& args);
+void c_find(const std::vector<std::string>& args);
+
+#endif // FINDER_H
@@ -0,0 +1,634 @@
+#include "hash.h"
+#include "base_tools.h"
+#include "c_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace hashing {
+    const size_t READ_SIZE = 1 << 20;
+    const uint64_t PARALLEL_MIN = 64ull << 20;              // smaller files are not worth the threads
+    const uint64_t CHUNK_SIZE = 16ull << 20;                // fixed, so tree digests do not depend on -j
+
+    // ---- CRC32C ----
+
+    const uint32_t CRC32C_POLY = 0x82F63B78;                // reflected Castagnoli polynomial
+
+    struct SliceTables {
+        uint32_t t[8][256];
+        SliceTables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int k = 0; k < 8; ++k) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+                }
+                t[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+                }
+            }
+        }
+    };
+
+    uint32_t crc32c_slice8(uint32_t crc, const uint8_t* p, size_t size) {
+        static const SliceTables tables;
+        const auto& t = tables.t;
+        crc = ~crc;
+        while (size >= 8) {
+            uint32_t lo, hi;
+            memcpy(&lo, p, 4);
+            memcpy(&hi, p + 4, 4);
+            lo ^= crc;
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                  t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            p += 8;
+            size -= 8;
+        }
+        while (size--) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        }
+        return ~crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t size) {
+        uint64_t value = ~crc;
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            value = _mm_crc32_u64(value, word);
+            p += 8;
+            size -= 8;
+        }
+        uint32_t value32 = static_cast<uint32_t>(value);
+        while (size--) {
+            value32 = _mm_crc32_u8(value32, *p++);
+        }
+        return ~value32;
+    }
+
+    bool have_sse42() {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#else
+    bool have_sse42() {
+        return false;
+    }
+#endif
+
+    uint32_t crc32c_update(uint32_t crc, const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(__x86_64__)
+        if (have_sse42()) {
+            return crc32c_sse42(crc, p, size);
+        }
+#endif
+        return crc32c_slice8(crc, p, size);
+    }
+
+    // Combines CRC(A) and CRC(B) into CRC(AB) in GF(2), the same way zlib's crc32_combine does
+    uint32_t gf2_matrix_times(const uint32_t* matrix, uint32_t vector) {
+        uint32_t sum = 0;
+        while (vector) {
+            if (vector & 1) {
+                sum ^= *matrix;
+            }
+            vector >>= 1;
+            ++matrix;
+        }
+        return sum;
+    }
+
+    void gf2_matrix_square(uint32_t* square, const uint32_t* matrix) {
+        for (int n = 0; n < 32; ++n) {
+            square[n] = gf2_matrix_times(matrix, matrix[n]);
+        }
+    }
+
+    uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+        if (length2 == 0) {
+            return crc1;
+        }
+        uint32_t even[32];
+        uint32_t odd[32];
+        odd[0] = CRC32C_POLY;                               // operator for one zero bit
+        uint32_t row = 1;
+        for (int n = 1; n < 32; ++n) {
+            odd[n] = row;
+            row <<= 1;
+        }
+        gf2_matrix_square(even, odd);                       // two zero bits
+        gf2_matrix_square(odd, even);                       // four zero bits
+        do {
+            gf2_matrix_square(even, odd);
+            if (length2 & 1) {
+                crc1 = gf2_matrix_times(even, crc1);
+            }
+            length2 >>= 1;
+            if (length2 == 0) {
+                break;
+            }
+            gf2_matrix_square(odd, even);
+            if (length2 & 1) {
+                crc1 = gf2_matrix_times(odd, crc1);
+            }
+            length2 >>= 1;
+        } while (length2 != 0);
+        return crc1 ^ crc2;
+    }
+
+    uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+        const Bytef* p = static_cast<const Bytef*>(data);
+        while (size > 0) {                                  // zlib takes uInt lengths
+            uInt n = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+            crc = static_cast<uint32_t>(::crc32(crc, p, n));
+            p += n;
+            size -= n;
+        }
+        return crc;
+    }
+
+    // ---- XXH64 ----
+
+    const uint64_t P64_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t P64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t P64_3 = 0x165667B19E3779F9ULL;
+    const uint64_t P64_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t P64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+        acc += input * P64_2;
+        acc = rotl64(acc, 31);
+        return acc * P64_1;
+    }
+
+    inline uint64_t xxh_merge(uint64_t acc, uint64_t value) {
+        acc ^= xxh_round(0, value);
+        return acc * P64_1 + P64_4;
+    }
+
+    void xxh64_init(Xxh64State& s) {
+        s.v[0] = P64_1 + P64_2;
+        s.v[1] = P64_2;
+        s.v[2] = 0;
+        s.v[3] = 0 - P64_1;
+        s.total = 0;
+        s.used = 0;
+    }
+
+    void xxh64_update(Xxh64State& s, const uint8_t* p, size_t size) {
+        s.total += size;
+        if (s.used + size < 32) {
+            memcpy(s.buffer + s.used, p, size);
+            s.used += size;
+            return;
+        }
+        if (s.used > 0) {
+            size_t fill = 32 - s.used;
+            memcpy(s.buffer + s.used, p, fill);
+            for (int i = 0; i < 4; ++i) {
+                s.v[i] = xxh_round(s.v[i], read64(s.buffer + 8 * i));
+            }
+            p += fill;
+            size -= fill;
+            s.used = 0;
+        }
+        while (size >= 32) {
+            s.v[0] = xxh_round(s.v[0], read64(p));
+            s.v[1] = xxh_round(s.v[1], read64(p + 8));
+            s.v[2] = xxh_round(s.v[2], read64(p + 16));
+            s.v[3] = xxh_round(s.v[3], read64(p + 24));
+            p += 32;
+            size -= 32;
+        }
+        memcpy(s.buffer, p, size);
+        s.used = size;
+    }
+
+    uint64_t xxh64_digest(const Xxh64State& s) {
+        uint64_t h;
+        if (s.total >= 32) {
+            h = rotl64(s.v[0], 1) + rotl64(s.v[1], 7) + rotl64(s.v[2], 12) + rotl64(s.v[3], 18);
+            for (int i = 0; i < 4; ++i) {
+                h = xxh_merge(h, s.v[i]);
+            }
+        } else {
+            h = P64_5;
+        }
+        h += s.total;
+        const uint8_t* p = s.buffer;
+        size_t size = s.used;
+        while (size >= 8) {
+            h ^= xxh_round(0, read64(p));
+            h = rotl64(h, 27) * P64_1 + P64_4;
+            p += 8;
+            size -= 8;
+        }
+        if (size >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * P64_1;
+            h = rotl64(h, 23) * P64_2 + P64_3;
+            p += 4;
+            size -= 4;
+        }
+        while (size--) {
+            h ^= (*p++) * P64_5;
+            h = rotl64(h, 11) * P64_1;
+        }
+        h ^= h >> 33;
+        h *= P64_2;
+        h ^= h >> 29;
+        h *= P64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // ---- SHA-256 ----
+
+    const uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline uint32_t rotr32(uint32_t x, int r) {
+        return (x >> r) | (x << (32 - r));
+    }
+
+    void sha256_init(Sha256State& s) {
+        static const uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        memcpy(s.h, initial, sizeof(initial));
+        s.length = 0;
+        s.used = 0;
+    }
+
+    void sha256_block(Sha256State& s, const uint8_t* p) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t(p[4 * i]) << 24) | (uint32_t(p[4 * i + 1]) << 16) | (uint32_t(p[4 * i + 2]) << 8) | uint32_t(p[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = s.h[0], b = s.h[1], c = s.h[2], d = s.h[3], e = s.h[4], f = s.h[5], g = s.h[6], h = s.h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        s.h[0] += a; s.h[1] += b; s.h[2] += c; s.h[3] += d;
+        s.h[4] += e; s.h[5] += f; s.h[6] += g; s.h[7] += h;
+    }
+
+    void sha256_update(Sha256State& s, const uint8_t* p, size_t size) {
+        s.length += size;
+        if (s.used > 0) {
+            size_t fill = std::min(size, 64 - s.used);
+            memcpy(s.block + s.used, p, fill);
+            s.used += fill;
+            p += fill;
+            size -= fill;
+            if (s.used < 64) {
+                return;
+            }
+            sha256_block(s, s.block);
+            s.used = 0;
+        }
+        while (size >= 64) {
+            sha256_block(s, p);
+            p += 64;
+            size -= 64;
+        }
+        memcpy(s.block, p, size);
+        s.used = size;
+    }
+
+    void sha256_final(Sha256State& s, uint8_t out[32]) {
+        uint64_t bits = s.length * 8;
+        uint8_t padding[72] = {0x80};
+        size_t padLength = (s.used < 56) ? (56 - s.used) : (120 - s.used);
+        uint8_t lengthBytes[8];
+        for (int i = 0; i < 8; ++i) {
+            lengthBytes[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        }
+        sha256_update(s, padding, padLength);
+        sha256_update(s, lengthBytes, 8);
+        for (int i = 0; i < 8; ++i) {
+            out[4 * i] = static_cast<uint8_t>(s.h[i] >> 24);
+            out[4 * i + 1] = static_cast<uint8_t>(s.h[i] >> 16);
+            out[4 * i + 2] = static_cast<uint8_t>(s.h[i] >> 8);
+            out[4 * i + 3] = static_cast<uint8_t>(s.h[i]);
+        }
+    }
+
+    // ---- Hasher ----
+
+    Hasher::Hasher(Algorithm algorithm) : algorithm(algorithm), crcValue(0) {
+        xxh64_init(xxh);
+        sha256_init(sha);
+    }
+
+    void Hasher::update(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        switch (algorithm) {
+            case Algorithm::CRC32:  crcValue = crc32_update(crcValue, p, size); break;
+            case Algorithm::CRC32C: crcValue = crc32c_update(crcValue, p, size); break;
+            case Algorithm::XXH64:  xxh64_update(xxh, p, size); break;
+            case Algorithm::SHA256: sha256_update(sha, p, size); break;
+        }
+    }
+
+    uint32_t Hasher::crc() const {
+        return crcValue;
+    }
+
+    std::vector<uint8_t> Hasher::digest() {
+        std::vector<uint8_t> out;
+        uint64_t value = 0;
+        switch (algorithm) {
+            case Algorithm::CRC32:
+            case Algorithm::CRC32C:
+                for (int i = 3; i >= 0; --i) {
+                    out.push_back(static_cast<uint8_t>(crcValue >> (8 * i)));
+                }
+                break;
+            case Algorithm::XXH64:
+                value = xxh64_digest(xxh);
+                for (int i = 7; i >= 0; --i) {
+                    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+                }
+                break;
+            case Algorithm::SHA256:
+                out.resize(32);
+                sha256_final(sha, out.data());
+                break;
+        }
+        return out;
+    }
+
+    std::string Hasher::hex_digest() {
+        static const char hex[] = "0123456789abcdef";
+        std::string text;
+        for (uint8_t byte : digest()) {
+            text += hex[byte >> 4];
+            text += hex[byte & 0xf];
+        }
+        return text;
+    }
+
+    bool parse_algorithm(const std::string& name, Algorithm& algorithm) {
+        if (name == "crc32") algorithm = Algorithm::CRC32;
+        else if (name == "crc32c") algorithm = Algorithm::CRC32C;
+        else if (name == "xxh64") algorithm = Algorithm::XXH64;
+        else if (name == "sha256") algorithm = Algorithm::SHA256;
+        else return false;
+        return true;
+    }
+
+    const char* algorithm_name(Algorithm algorithm) {
+        switch (algorithm) {
+            case Algorithm::CRC32:  return "crc32";
+            case Algorithm::CRC32C: return "crc32c";
+            case Algorithm::XXH64:  return "xxh64";
+            case Algorithm::SHA256:
+            default:                return "sha256";
+        }
+    }
+
+    const char* backend_name(Algorithm algorithm) {
+        switch (algorithm) {
+            case Algorithm::CRC32:  return "zlib";
+            case Algorithm::CRC32C: return have_sse42() ? "sse4.2" : "slice-by-8";
+            case Algorithm::XXH64:
+            case Algorithm::SHA256:
+            default:                return "portable";
+        }
+    }
+
+    // ---- files ----
+
+    bool hash_range(int fd, uint64_t offset, uint64_t length, Hasher& hasher) {
+        std::vector<char> buffer(std::min<uint64_t>(READ_SIZE, std::max<uint64_t>(length, 1)));
+        while (length > 0) {
+            ssize_t n = pread(fd, buffer.data(), std::min<uint64_t>(buffer.size(), length), static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                return n == 0;                              // file shrank while hashing
+            }
+            hasher.update(buffer.data(), static_cast<size_t>(n));
+            offset += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    unsigned pick_threads(unsigned threads, uint64_t size) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        uint64_t chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        return static_cast<unsigned>(std::max<uint64_t>(1, std::min<uint64_t>(threads, chunks)));
+    }
+
+    // Hashes every CHUNK_SIZE slice of the file with its own Hasher, spread over the threads
+    bool hash_chunks(int fd, uint64_t size, Algorithm algorithm, unsigned threads, std::vector<Hasher>& hashers) {
+        size_t chunks = static_cast<size_t>((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        hashers.assign(chunks, Hasher(algorithm));
+        std::vector<char> failed(threads, 0);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (size_t chunk = t; chunk < chunks; chunk += threads) {
+                    uint64_t offset = chunk * CHUNK_SIZE;
+                    if (!hash_range(fd, offset, std::min(CHUNK_SIZE, size - offset), hashers[chunk])) {
+                        failed[t] = 1;
+                        return;
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        return std::find(failed.begin(), failed.end(), 1) == failed.end();
+    }
+
+    int open_for_hashing(const std::string& path, uint64_t& size) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error_message_no_halt("hash", "Cannot open FILE: '" + path + "': " + strerror(errno));
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            error_message_no_halt("hash", "Cannot stat FILE: '" + path + "': " + strerror(errno));
+            close(fd);
+            return -1;
+        }
+        size = static_cast<uint64_t>(st.st_size);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return fd;
+    }
+
+    bool crc_file(const std::string& path, Algorithm algorithm, uint32_t& crc, unsigned threads) {
+        if (algorithm != Algorithm::CRC32 && algorithm != Algorithm::CRC32C) {
+            return false;
+        }
+        uint64_t size = 0;
+        int fd = open_for_hashing(path, size);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok;
+        threads = pick_threads(threads, size);
+        if (size < PARALLEL_MIN || threads == 1) {
+            Hasher hasher(algorithm);
+            ok = hash_range(fd, 0, size, hasher);
+            crc = hasher.crc();
+        } else {
+            std::vector<Hasher> hashers;
+            ok = hash_chunks(fd, size, algorithm, threads, hashers);
+            crc = 0;
+            for (size_t chunk = 0; ok && chunk < hashers.size(); ++chunk) {
+                uint64_t length = std::min(CHUNK_SIZE, size - chunk * CHUNK_SIZE);
+                crc = (algorithm == Algorithm::CRC32)
+                    ? static_cast<uint32_t>(crc32_combine(crc, hashers[chunk].crc(), static_cast<z_off_t>(length)))
+                    : crc32c_combine(crc, hashers[chunk].crc(), length);
+            }
+        }
+        close(fd);
+        if (!ok) {
+            error_message_no_halt("hash", "Read error on FILE: '" + path + "'");
+        }
+        return ok;
+    }
+
+    bool hash_file(const std::string& path, Algorithm algorithm, std::string& digest, unsigned threads, bool tree) {
+        if (algorithm == Algorithm::CRC32 || algorithm == Algorithm::CRC32C) {
+            uint32_t crc = 0;
+            if (!crc_file(path, algorithm, crc, threads)) {
+                return false;
+            }
+            char text[9];
+            snprintf(text, sizeof(text), "%08x", crc);
+            digest = text;
+            return true;
+        }
+        uint64_t size = 0;
+        int fd = open_for_hashing(path, size);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok;
+        if (!tree) {
+            Hasher hasher(algorithm);
+            ok = hash_range(fd, 0, size, hasher);
+            digest = hasher.hex_digest();
+        } else {                                            // digest of the ordered chunk digests
+            std::vector<Hasher> hashers;
+            ok = hash_chunks(fd, size, algorithm, pick_threads(threads, size), hashers);
+            Hasher root(algorithm);
+            for (Hasher& chunk : hashers) {
+                std::vector<uint8_t> leaf = chunk.digest();
+                root.update(leaf.data(), leaf.size());
+            }
+            digest = root.hex_digest();
+        }
+        close(fd);
+        if (!ok) {
+            error_message_no_halt("hash", "Read error on FILE: '" + path + "'");
+        }
+        return ok;
+    }
+}
+
+void c_hash(const std::vector<std::string>& args) {
+    hashing::Algorithm algorithm = hashing::Algorithm::CRC32C;
+    unsigned threads = 0;
+    bool tree = false;
+    bool verbose = false;
+    std::vector<std::string> files;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-a" && i + 1 < args.size()) {
+            if (!hashing::parse_algorithm(args[++i], algorithm)) {
+                error_message_no_halt("hash", "unknown algorithm '" + args[i] + "' (crc32, crc32c, xxh64, sha256)");
+                return;
+            }
+        } else if (args[i] == "-j" && i + 1 < args.size()) {
+            threads = static_cast<unsigned>(std::max(1, stringToInt(args[++i])));
+        } else if (args[i] == "-t") {
+            tree = true;
+        } else if (args[i] == "-v") {
+            verbose = true;
+        } else {
+            files.push_back(args[i]);
+        }
+    }
+    if (files.empty()) {
+        std::cout << "Usage: hash [-a crc32|crc32c|xxh64|sha256] [-j threads] [-t tree mode] [-v] <file>...\n";
+        return;
+    }
+    if (verbose) {
+        std::cout << "hash: " << hashing::algorithm_name(algorithm) << " using " << hashing::backend_name(algorithm) << "\n";
+    }
+    for (const std::string& file : files) {
+        auto start = std::chrono::steady_clock::now();
+        std::string digest;
+        if (!hashing::hash_file(file, algorithm, digest, threads, tree)) {
+            continue;
+        }
+        std::cout << digest << "  " << file;
+        if (verbose) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double megabytes = static_cast<double>(tools::getFileSize(file)) / (1024 * 1024);
+            std::cout << "  (" << megabytes / std::max(seconds, 1e-9) << " MB/s)";
+        }
+        std::cout << "\n";
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hashing {
+    enum class Algorithm {
+        CRC32,                      // zlib/gzip polynomial
+        CRC32C,                     // Castagnoli, SSE4.2 crc32 instruction when available
+        XXH64,
+        SHA256
+    };
+
+    struct Xxh64State {
+        uint64_t v[4];
+        uint64_t total;
+        uint8_t buffer[32];
+        size_t used;
+    };
+
+    struct Sha256State {
+        uint32_t h[8];
+        uint64_t length;
+        uint8_t block[64];
+        size_t used;
+    };
+
+    class Hasher {                  // incremental hashing of a byte stream
+    public:
+        explicit Hasher(Algorithm algorithm);
+        void update(const void* data, size_t size);
+        std::vector<uint8_t> digest();
+        std::string hex_digest();
+        uint32_t crc() const;       // CRC32/CRC32C value so far
+
+    private:
+        Algorithm algorithm;
+        uint32_t crcValue;
+        Xxh64State xxh;
+        Sha256State sha;
+    };
+
+    bool parse_algorithm(const std::string& name, Algorithm& algorithm);
+    const char* algorithm_name(Algorithm algorithm);
+    const char* backend_name(Algorithm algorithm);
+
+    uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+    uint32_t crc32c_update(uint32_t crc, const void* data, size_t size);
+    uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+    // Hashes a whole file, large files in parallel chunks. CRCs are combined into the exact serial
+    // value; XXH64/SHA256 can only be split in tree mode, which hashes the per chunk digests.
+    bool hash_file(const std::string& path, Algorithm algorithm, std::string& digest, unsigned threads = 0, bool tree = false);
+    bool crc_file(const std::string& path, Algorithm algorithm, uint32_t& crc, unsigned threads = 0);
+}
+
+void c_hash(const std::vector<std::string>& args);
+
+#endif // HASH_H
@@ -0,0 +1,428 @@
+#include "ls_colors.h"
+#include "base_tools.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <sys/stat.h>
+
+namespace ls_colors {
+    const size_t INITIAL_SLOTS = 64;
+
+    // Same colors the listing had before LS_COLORS was read
+    const char* const BUILT_IN =
+        "di=01;34:ln=32:ex=32:"
+        "*.msi=32:*.exe=32:*.sh=32:*.gz=31:*.xz=31:*.h=35:*.conf=33:*.c=92:*.cpp=92";
+
+    struct Code {
+        const char* key;
+        int kind;                   // Kind, or one of the negative values below
+    };
+
+    const int LEFT = -1, RIGHT = -2, END = -3, RESET = -4, IGNORED = -5;
+
+    const Code CODES[] = {
+        {"no", NORMAL}, {"fi", FILE}, {"di", DIRECTORY}, {"ln", LINK}, {"pi", FIFO}, {"so", SOCKET},
+        {"bd", BLOCK_DEVICE}, {"cd", CHARACTER_DEVICE}, {"or", ORPHAN}, {"ex", EXECUTABLE},
+        {"su", SETUID}, {"sg", SETGID}, {"tw", STICKY_OTHER_WRITABLE}, {"ow", OTHER_WRITABLE},
+        {"st", STICKY}, {"mh", MULTI_HARDLINK},
+        {"lc", LEFT}, {"rc", RIGHT}, {"ec", END}, {"rs", RESET},
+        {"mi", IGNORED}, {"do", IGNORED}, {"ca", IGNORED}, {"cl", IGNORED}
+    };
+
+    uint32_t hash_lower(std::string_view text) {
+        uint32_t hash = 2166136261u;                        // FNV-1a
+        for (char c : text) {
+            hash ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(c)));
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    bool equal_lower(std::string_view text, const std::string& lower) {
+        if (text.size() != lower.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(text[i])) != static_cast<unsigned char>(lower[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string lower(std::string text) {
+        for (char& c : text) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return text;
+    }
+
+    // "00" and "0" reset to the terminal default, so like an empty value they mean "not colored"
+    bool colored(const std::string& codes) {
+        return !codes.empty() && codes != "0" && codes != "00";
+    }
+
+    // One key or value with dircolors escapes: \e, \n, \_ (space), octal and \x hex, and ^X.
+    // Stops at an unescaped stop byte or at the end.
+    bool decode(const std::string& spec, size_t& pos, char stop, std::string& out) {
+        while (pos < spec.size() && spec[pos] != stop && spec[pos] != ':') {
+            char c = spec[pos++];
+            if (c == '^') {
+                if (pos == spec.size()) {
+                    return false;
+                }
+                char next = spec[pos++];
+                if (next == '?') {
+                    out += '\177';
+                } else if ((next >= '@' && next <= '_') || (next >= 'a' && next <= 'z')) {
+                    out += static_cast<char>(next & 0x1f);
+                } else {
+                    return false;
+                }
+            } else if (c == '\\') {
+                if (pos == spec.size()) {
+                    return false;
+                }
+                char next = spec[pos++];
+                int value = 0;
+                switch (next) {
+                    case 'a': out += '\a'; break;
+                    case 'b': out += '\b'; break;
+                    case 'e': out += '\033'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'v': out += '\v'; break;
+                    case '?': out += '\177'; break;
+                    case '_': out += ' '; break;
+                    case 'x':
+                    case 'X':
+                        for (int digits = 0; digits < 2 && pos < spec.size() && std::isxdigit(static_cast<unsigned char>(spec[pos])); ++digits) {
+                            char h = spec[pos++];
+                            value = value * 16 + (std::isdigit(static_cast<unsigned char>(h)) ? h - '0' : std::tolower(h) - 'a' + 10);
+                        }
+                        out += static_cast<char>(value);
+                        break;
+                    default:
+                        if (next >= '0' && next <= '7') {
+                            value = next - '0';
+                            for (int digits = 1; digits < 3 && pos < spec.size() && spec[pos] >= '0' && spec[pos] <= '7'; ++digits) {
+                                value = value * 8 + (spec[pos++] - '0');
+                            }
+                            out += static_cast<char>(value);
+                        } else {
+                            out += next;                    // \: \= \\ and the like
+                        }
+                }
+            } else {
+                out += c;
+            }
+        }
+        return true;
+    }
+
+    Theme::Theme() {
+        parse(BUILT_IN);
+        directoryLinks = true;
+    }
+
+    Theme::Theme(const std::string& spec) {
+        parse(spec);
+    }
+
+    const Theme& Theme::current() {
+        static const std::unique_ptr<const Theme> theme = [] {
+            const char* spec = std::getenv("LS_COLORS");
+            if (spec == nullptr || *spec == '\0') {
+                return std::make_unique<const Theme>();
+            }
+            auto parsedTheme = std::make_unique<const Theme>(spec);
+            if (!parsedTheme->valid()) {
+                error_message_no_halt("ls", "unparsable value for LS_COLORS, listing without colors");
+            }
+            return parsedTheme;
+        }();
+        return *theme;
+    }
+
+    // Two passes: lc and rc may come after the entries they wrap
+    void Theme::parse(const std::string& spec) {
+        std::vector<std::pair<std::string, std::string>> entries;
+        size_t pos = 0;
+        while (pos < spec.size()) {
+            if (spec[pos] == ':') {
+                ++pos;
+                continue;
+            }
+            std::string key, value;
+            if (spec[pos] == '*') {
+                ++pos;
+                if (!decode(spec, pos, '=', key) || key.empty()) {
+                    parsed = false;
+                    break;
+                }
+                key.insert(key.begin(), '*');
+            } else {
+                key = spec.substr(pos, 2);
+                pos += 2;
+            }
+            if (pos >= spec.size() || spec[pos] != '=') {
+                parsed = false;
+                break;
+            }
+            ++pos;
+            if (!decode(spec, pos, ':', value)) {
+                parsed = false;
+                break;
+            }
+            entries.emplace_back(std::move(key), std::move(value));
+        }
+        if (!parsed) {
+            resetSequence.clear();
+            return;
+        }
+
+        std::string end, resetCodes = "0";
+        bool hasEnd = false;
+        for (const auto& entry : entries) {
+            if (entry.first == "lc") {
+                left = entry.second;
+            } else if (entry.first == "rc") {
+                right = entry.second;
+            } else if (entry.first == "ec") {
+                end = entry.second;
+                hasEnd = true;
+            } else if (entry.first == "rs") {
+                resetCodes = entry.second;
+            }
+        }
+        resetSequence = hasEnd ? end : left + resetCodes + right;
+
+        for (const auto& entry : entries) {
+            const std::string& key = entry.first;
+            const std::string& value = entry.second;
+            if (key[0] == '*') {
+                std::string suffix = lower(key.substr(1));
+                const char* color = store(value);
+                if (suffix.size() > 1 && suffix[0] == '.' && suffix.find('.', 1) == std::string::npos) {
+                    insert_extension(suffix.substr(1), color);
+                } else {
+                    unsigned char last = static_cast<unsigned char>(suffix.back());
+                    suffixEnds.set(last);
+                    suffixEnds.set(static_cast<unsigned char>(std::toupper(last)));
+                    suffixes.emplace_back(std::move(suffix), color);
+                }
+                continue;
+            }
+            const Code* code = nullptr;
+            for (const Code& candidate : CODES) {
+                if (key == candidate.key) {
+                    code = &candidate;
+                    break;
+                }
+            }
+            if (code == nullptr) {
+                parsed = false;
+                break;
+            }
+            if (code->kind == LINK && value == "target") {
+                linkTarget = true;
+            } else if (code->kind >= 0) {
+                kinds[code->kind] = colored(value) ? store(value) : nullptr;
+            }
+        }
+        if (!parsed) {
+            std::fill(std::begin(kinds), std::end(kinds), nullptr);
+            slots.clear();
+            suffixes.clear();
+            suffixEnds.reset();
+            linkTarget = false;
+            resetSequence.clear();
+        }
+    }
+
+    const char* Theme::store(const std::string& codes) {
+        sequences.push_back(left + codes + right);
+        return sequences.back().c_str();
+    }
+
+    void Theme::insert_extension(const std::string& extension, const char* color) {
+        if ((used + 1) * 2 > slots.size()) {
+            grow();
+        }
+        uint32_t hash = hash_lower(extension);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.color == nullptr) {
+                slot = {hash, color, extension};
+                ++used;
+                return;
+            }
+            if (slot.hash == hash && slot.extension == extension) {
+                slot.color = color;                         // a later rule wins, as in GNU ls
+                return;
+            }
+        }
+    }
+
+    void Theme::grow() {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(old.empty() ? INITIAL_SLOTS : old.size() * 2, Slot{0, nullptr, std::string()});
+        size_t mask = slots.size() - 1;
+        for (Slot& slot : old) {
+            if (slot.color == nullptr) {
+                continue;
+            }
+            size_t i = slot.hash & mask;
+            while (slots[i].color != nullptr) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = std::move(slot);
+        }
+    }
+
+    const char* Theme::name_color(std::string_view name) const {
+        if (!suffixes.empty() && suffixEnds.test(static_cast<unsigned char>(name.back()))) {
+            for (auto it = suffixes.rbegin(); it != suffixes.rend(); ++it) {
+                const std::string& suffix = it->first;
+                if (name.size() >= suffix.size() && equal_lower(name.substr(name.size() - suffix.size()), suffix)) {
+                    return it->second;
+                }
+            }
+        }
+        size_t dot = name.rfind('.');
+        if (dot == std::string_view::npos || slots.empty()) {
+            return nullptr;
+        }
+        std::string_view extension = name.substr(dot + 1);
+        uint32_t hash = hash_lower(extension);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; slots[i].color != nullptr; i = (i + 1) & mask) {
+            if (slots[i].hash == hash && equal_lower(extension, slots[i].extension)) {
+                return slots[i].color;
+            }
+        }
+        return nullptr;
+    }
+
+    // GNU ls precedence: setuid, setgid, executable and hard link rules before extensions,
+    // sticky and other-writable rules before di
+    const char* Theme::mode_color(std::string_view name, mode_t mode, nlink_t links) const {
+        switch (mode & S_IFMT) {
+            case S_IFREG: {
+                if ((mode & S_ISUID) && kinds[SETUID]) {
+                    return kinds[SETUID];
+                }
+                if ((mode & S_ISGID) && kinds[SETGID]) {
+                    return kinds[SETGID];
+                }
+                if ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) && kinds[EXECUTABLE]) {
+                    return kinds[EXECUTABLE];
+                }
+                if (links > 1 && kinds[MULTI_HARDLINK]) {
+                    return kinds[MULTI_HARDLINK];
+                }
+                const char* color = name_color(name);
+                if (color) {
+                    return color;
+                }
+                return kinds[FILE] ? kinds[FILE] : kinds[NORMAL];
+            }
+            case S_IFDIR: {
+                bool sticky = mode & S_ISVTX;
+                bool otherWritable = mode & S_IWOTH;
+                if (sticky && otherWritable && kinds[STICKY_OTHER_WRITABLE]) {
+                    return kinds[STICKY_OTHER_WRITABLE];
+                }
+                if (otherWritable && kinds[OTHER_WRITABLE]) {
+                    return kinds[OTHER_WRITABLE];
+                }
+                if (sticky && kinds[STICKY]) {
+                    return kinds[STICKY];
+                }
+                return kinds[DIRECTORY];
+            }
+            case S_IFLNK:  return kinds[LINK];
+            case S_IFIFO:  return kinds[FIFO];
+            case S_IFSOCK: return kinds[SOCKET];
+            case S_IFBLK:  return kinds[BLOCK_DEVICE];
+            case S_IFCHR:  return kinds[CHARACTER_DEVICE];
+            default:       return kinds[NORMAL];
+        }
+    }
+
+    // The target is only stat'ed when something depends on it: ln=target, an or rule, or the
+    // built in theme's blue links to directories
+    const char* Theme::link_color(int dirfd, const std::string& name) const {
+        if (!linkTarget && !directoryLinks && !kinds[ORPHAN]) {
+            return kinds[LINK];
+        }
+        struct stat st;
+        if (fstatat(dirfd, name.c_str(), &st, 0) != 0) {
+            if (kinds[ORPHAN]) {
+                return kinds[ORPHAN];
+            }
+            return linkTarget ? nullptr : kinds[LINK];
+        }
+        if (linkTarget) {
+            return mode_color(name, st.st_mode, st.st_nlink);
+        }
+        if (directoryLinks && S_ISDIR(st.st_mode)) {
+            return kinds[DIRECTORY];
+        }
+        return kinds[LINK];
+    }
+
+    bool Theme::regular_needs_mode() const {
+        return kinds[SETUID] || kinds[SETGID] || kinds[EXECUTABLE] || kinds[MULTI_HARDLINK];
+    }
+
+    bool Theme::directory_needs_mode() const {
+        return kinds[STICKY_OTHER_WRITABLE] || kinds[OTHER_WRITABLE] || kinds[STICKY];
+    }
+
+    const char* Theme::color(int dirfd, const walker::Entry& entry) const {
+        if (!parsed) {
+            return nullptr;
+        }
+        switch (entry.type) {
+            case DT_REG:
+                if (!regular_needs_mode()) {
+                    return mode_color(entry.name, S_IFREG, 1);
+                }
+                break;
+            case DT_DIR:
+                if (!directory_needs_mode()) {
+                    return kinds[DIRECTORY];
+                }
+                break;
+            case DT_LNK:  return link_color(dirfd, entry.name);
+            case DT_FIFO: return kinds[FIFO];
+            case DT_SOCK: return kinds[SOCKET];
+            case DT_BLK:  return kinds[BLOCK_DEVICE];
+            case DT_CHR:  return kinds[CHARACTER_DEVICE];
+            default:
+                break;
+        }
+        struct stat st;
+        if (fstatat(dirfd, entry.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            return mode_color(entry.name, entry.type == DT_UNKNOWN ? S_IFREG : DTTOIF(entry.type), 1);
+        }
+        return color(dirfd, entry.name, st.st_mode, st.st_nlink);
+    }
+
+    const char* Theme::color(int dirfd, const std::string& name, mode_t mode, nlink_t links) const {
+        if (!parsed) {
+            return nullptr;
+        }
+        return S_ISLNK(mode) ? link_color(dirfd, name) : mode_color(name, mode, links);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef LS_COLORS_H
+#define LS_COLORS_H
+
+#include "walker.h"
+
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace ls_colors {
+    enum Kind {
+        NORMAL,                     // no
+        FILE,                       // fi
+        DIRECTORY,                  // di
+        LINK,                       // ln
+        FIFO,                       // pi
+        SOCKET,                     // so
+        BLOCK_DEVICE,               // bd
+        CHARACTER_DEVICE,           // cd
+        ORPHAN,                     // or: link to nothing
+        EXECUTABLE,                 // ex
+        SETUID,                     // su
+        SETGID,                     // sg
+        STICKY_OTHER_WRITABLE,      // tw
+        OTHER_WRITABLE,             // ow
+        STICKY,                     // st
+        MULTI_HARDLINK,             // mh
+        KIND_COUNT
+    };
+
+    // LS_COLORS compiled once. Every color is stored as the complete escape sequence, ready to
+    // append. "*.ext" rules live in an open addressing table, so an extension costs one hash and
+    // usually one probe; other suffix rules ("*~", "*.tar.gz") are only scanned when the name
+    // ends in a byte one of them ends in.
+    class Theme {
+    public:
+        Theme();                                    // the built in colors, for when LS_COLORS is unset
+        explicit Theme(const std::string& spec);    // dircolors syntax; an unparsable spec colors nothing
+        Theme(const Theme&) = delete;
+        Theme& operator=(const Theme&) = delete;
+
+        static const Theme& current();              // from LS_COLORS, parsed on first use
+
+        // fstatat() only when the type from getdents64 is not enough: mode dependent rules,
+        // link targets, DT_UNKNOWN
+        const char* color(int dirfd, const walker::Entry& entry) const;
+        // For when the lstat mode is already known, as in the long format
+        const char* color(int dirfd, const std::string& name, mode_t mode, nlink_t links) const;
+        const std::string& reset() const { return resetSequence; }
+
+        bool valid() const { return parsed; }
+
+    private:
+        struct Slot {
+            uint32_t hash;
+            const char* color;                      // nullptr for an empty slot
+            std::string extension;                  // lower case, without the dot
+        };
+
+        void parse(const std::string& spec);
+        const char* store(const std::string& codes);
+        void insert_extension(const std::string& extension, const char* color);
+        void grow();
+        const char* name_color(std::string_view name) const;
+        const char* mode_color(std::string_view name, mode_t mode, nlink_t links) const;
+        const char* link_color(int dirfd, const std::string& name) const;
+        bool regular_needs_mode() const;
+        bool directory_needs_mode() const;
+
+        std::string left = "\033[";                 // lc, rc: what goes around every code
+        std::string right = "m";
+        std::string resetSequence = "\033[0m";
+        std::deque<std::string> sequences;          // the pointers below point into it
+        const char* kinds[KIND_COUNT] = {};
+        std::vector<Slot> slots;                    // power of two, at most half full
+        size_t used = 0;
+        std::vector<std::pair<std::string, const char*>> suffixes;
+        std::bitset<256> suffixEnds;                // last bytes of the suffixes, both cases
+        bool linkTarget = false;                    // ln=target: links take their target's color
+        bool directoryLinks = false;                // built in theme: links to directories as di
+        bool parsed = true;
+    };
+}
+
+#endif // LS_COLORS_H
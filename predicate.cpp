@@ -0,0 +1,524 @@
+#include "predicate.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <regex.h>
+
+namespace predicate {
+    Expression all(std::vector<Expression> operands) {
+        Expression expression;
+        expression.kind = Kind::And;
+        expression.operands = std::move(operands);
+        return expression;
+    }
+
+    Expression any(std::vector<Expression> operands) {
+        Expression expression;
+        expression.kind = Kind::Or;
+        expression.operands = std::move(operands);
+        return expression;
+    }
+
+    Expression negate(Expression operand) {
+        Expression expression;
+        expression.kind = Kind::Not;
+        expression.operands.push_back(std::move(operand));
+        return expression;
+    }
+
+    Expression name(const std::string& pattern, bool ignoreCase) {
+        Expression expression;
+        expression.kind = Kind::Name;
+        expression.text = pattern;
+        expression.ignoreCase = ignoreCase;
+        return expression;
+    }
+
+    bool regex(const std::string& pattern, Expression& expression, std::string& error) {
+        auto* compiled = new regex_t;
+        int flags = REG_EXTENDED | REG_NOSUB | (expression.ignoreCase ? REG_ICASE : 0);
+        int status = regcomp(compiled, ("^(" + pattern + ")$").c_str(), flags);    // find matches the whole path
+        if (status != 0) {
+            char message[256];
+            regerror(status, compiled, message, sizeof(message));
+            error = "bad regex '" + pattern + "': " + message;
+            delete compiled;
+            return false;
+        }
+        expression.kind = Kind::Regex;
+        expression.text = pattern;
+        expression.regex = std::shared_ptr<void>(compiled, [](void* p) {
+            regfree(static_cast<regex_t*>(p));
+            delete static_cast<regex_t*>(p);
+        });
+        return true;
+    }
+
+    Expression extension(const std::string& extension) {
+        Expression expression;
+        expression.kind = Kind::Extension;
+        expression.text = extension;
+        return expression;
+    }
+
+    Expression type(unsigned mask) {
+        Expression expression;
+        expression.kind = Kind::Type;
+        expression.mask = mask;
+        return expression;
+    }
+
+    Expression size(int compare, int64_t value, int64_t unit) {
+        Expression expression;
+        expression.kind = Kind::Size;
+        expression.compare = compare;
+        expression.value = value;
+        expression.unit = unit;
+        return expression;
+    }
+
+    Expression age(int compare, int64_t value, int64_t unit) {
+        Expression expression;
+        expression.kind = Kind::Age;
+        expression.compare = compare;
+        expression.value = value;
+        expression.unit = unit;
+        return expression;
+    }
+
+    Expression newer(const struct timespec& reference) {
+        Expression expression;
+        expression.kind = Kind::Newer;
+        expression.reference = reference;
+        return expression;
+    }
+
+    Expression permissions(mode_t mode, PermissionMatch match) {
+        Expression expression;
+        expression.kind = Kind::Permissions;
+        expression.mode = mode;
+        expression.permissionMatch = match;
+        return expression;
+    }
+
+    unsigned type_bit(unsigned char dtype) {
+        switch (dtype) {
+            case DT_REG: return TYPE_FILE;
+            case DT_DIR: return TYPE_DIRECTORY;
+            case DT_LNK: return TYPE_SYMLINK;
+            case DT_FIFO: return TYPE_FIFO;
+            case DT_SOCK: return TYPE_SOCKET;
+            case DT_CHR: return TYPE_CHARACTER;
+            case DT_BLK: return TYPE_BLOCK;
+            default: return 0;
+        }
+    }
+
+    // ---- find syntax ----
+
+    struct Parser {
+        const std::vector<std::string>& words;
+        size_t& position;
+        std::string& error;
+
+        bool at_end() const { return position >= words.size(); }
+        const std::string& peek() const { return words[position]; }
+
+        static bool is_open(const std::string& word) { return word == "(" || word == "\\("; }
+        static bool is_close(const std::string& word) { return word == ")" || word == "\\)"; }
+        static bool is_not(const std::string& word) { return word == "!" || word == "-not"; }
+
+        static bool is_test(const std::string& word) {
+            static const char* const TESTS[] = {"-name", "-iname", "-regex", "-iregex", "-type", "-size",
+                                                "-mtime", "-mmin", "-newer", "-perm"};
+            return std::find_if(std::begin(TESTS), std::end(TESTS), [&word](const char* test) { return word == test; })
+                   != std::end(TESTS);
+        }
+
+        bool starts_operand() const {
+            return !at_end() && (is_open(peek()) || is_not(peek()) || is_test(peek()));
+        }
+
+        bool parse_or(Expression& expression) {
+            std::vector<Expression> operands(1);
+            if (!parse_and(operands.back())) return false;
+            while (!at_end() && (peek() == "-o" || peek() == "-or")) {
+                ++position;
+                operands.emplace_back();
+                if (!parse_and(operands.back())) return false;
+            }
+            expression = operands.size() == 1 ? std::move(operands[0]) : any(std::move(operands));
+            return true;
+        }
+
+        bool parse_and(Expression& expression) {
+            std::vector<Expression> operands(1);
+            if (!parse_unary(operands.back())) return false;
+            while (!at_end()) {
+                if (peek() == "-a" || peek() == "-and") {
+                    ++position;
+                } else if (!starts_operand()) {
+                    break;
+                }
+                operands.emplace_back();
+                if (!parse_unary(operands.back())) return false;
+            }
+            expression = operands.size() == 1 ? std::move(operands[0]) : all(std::move(operands));
+            return true;
+        }
+
+        bool parse_unary(Expression& expression) {
+            if (at_end()) {
+                error = "expression ends too early";
+                return false;
+            }
+            if (is_not(peek())) {
+                ++position;
+                Expression operand;
+                if (!parse_unary(operand)) return false;
+                expression = negate(std::move(operand));
+                return true;
+            }
+            if (is_open(peek())) {
+                ++position;
+                if (!parse_or(expression)) return false;
+                if (at_end() || !is_close(peek())) {
+                    error = "missing ')'";
+                    return false;
+                }
+                ++position;
+                return true;
+            }
+            return parse_test(expression);
+        }
+
+        // "+N" more than, "-N" less than, "N" exactly; the unit letter, if any, is left in suffix
+        bool parse_number(const std::string& text, int& compare, int64_t& value, std::string& suffix) {
+            size_t start = 0;
+            compare = 0;
+            if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+                compare = text[0] == '+' ? 1 : -1;
+                start = 1;
+            }
+            size_t end = start;
+            while (end < text.size() && text[end] >= '0' && text[end] <= '9') ++end;
+            if (end == start || end - start > 18) {
+                return false;
+            }
+            value = std::stoll(text.substr(start, end - start));
+            suffix = text.substr(end);
+            return true;
+        }
+
+        bool parse_test(Expression& expression) {
+            const std::string test = peek();
+            if (!is_test(test)) {
+                error = "unknown predicate '" + test + "'";
+                return false;
+            }
+            if (position + 1 >= words.size()) {
+                error = "missing argument to '" + test + "'";
+                return false;
+            }
+            const std::string& argument = words[position + 1];
+            position += 2;
+
+            int compare;
+            int64_t value;
+            std::string suffix;
+            if (test == "-name" || test == "-iname") {
+                expression = name(argument, test == "-iname");
+                return true;
+            }
+            if (test == "-regex" || test == "-iregex") {
+                expression.ignoreCase = test == "-iregex";
+                return regex(argument, expression, error);
+            }
+            if (test == "-type") {
+                unsigned mask = 0;
+                for (char letter : argument) {
+                    switch (letter) {
+                        case 'f': mask |= TYPE_FILE; break;
+                        case 'd': mask |= TYPE_DIRECTORY; break;
+                        case 'l': mask |= TYPE_SYMLINK; break;
+                        case 'p': mask |= TYPE_FIFO; break;
+                        case 's': mask |= TYPE_SOCKET; break;
+                        case 'c': mask |= TYPE_CHARACTER; break;
+                        case 'b': mask |= TYPE_BLOCK; break;
+                        case ',': break;
+                        default:
+                            error = "unknown type '" + argument + "' (f, d, l, p, s, c, b)";
+                            return false;
+                    }
+                }
+                expression = type(mask);
+                return true;
+            }
+            if (test == "-size") {
+                if (!parse_number(argument, compare, value, suffix) || suffix.size() > 1) {
+                    error = "bad size '" + argument + "'";
+                    return false;
+                }
+                int64_t unit = 512;                         // find counts 512 byte blocks by default
+                switch (suffix.empty() ? 'b' : suffix[0]) {
+                    case 'c': unit = 1; break;
+                    case 'w': unit = 2; break;
+                    case 'b': unit = 512; break;
+                    case 'k': unit = 1024; break;
+                    case 'M': unit = 1024 * 1024; break;
+                    case 'G': unit = 1024 * 1024 * 1024; break;
+                    default:
+                        error = "bad size unit in '" + argument + "'";
+                        return false;
+                }
+                expression = size(compare, value, unit);
+                return true;
+            }
+            if (test == "-mtime" || test == "-mmin") {
+                if (!parse_number(argument, compare, value, suffix) || !suffix.empty()) {
+                    error = "bad number '" + argument + "' for '" + test + "'";
+                    return false;
+                }
+                expression = age(compare, value, test == "-mtime" ? 86400 : 60);
+                return true;
+            }
+            if (test == "-newer") {
+                struct stat st;
+                if (stat(argument.c_str(), &st) != 0) {
+                    error = "cannot stat '" + argument + "'";
+                    return false;
+                }
+                expression = newer(st.st_mtim);
+                return true;
+            }
+            // -perm
+            PermissionMatch match = PermissionMatch::Exact;
+            std::string digits = argument;
+            if (!digits.empty() && (digits[0] == '-' || digits[0] == '/')) {
+                match = digits[0] == '-' ? PermissionMatch::All : PermissionMatch::Any;
+                digits.erase(0, 1);
+            }
+            if (digits.empty() || digits.size() > 4 || digits.find_first_not_of("01234567") != std::string::npos) {
+                error = "only octal modes are supported for -perm, not '" + argument + "'";
+                return false;
+            }
+            expression = permissions(static_cast<mode_t>(std::stoul(digits, nullptr, 8)), match);
+            return true;
+        }
+    };
+
+    bool parse(const std::vector<std::string>& words, size_t& position, Expression& expression, std::string& error) {
+        Parser parser{words, position, error};
+        if (parser.at_end()) {
+            expression = all({});
+            return true;
+        }
+        if (!parser.parse_or(expression)) {
+            return false;
+        }
+        if (!parser.at_end() && Parser::is_close(parser.peek())) {
+            error = "unexpected ')'";
+            return false;
+        }
+        return true;
+    }
+
+    // ---- evaluation ----
+
+    Candidate::Candidate(int dirfd, const std::string& directoryPath, const std::string& name, unsigned char type)
+        : dirfd(dirfd), directoryPath(directoryPath), entryName(name), entryType(type), statState(0) {}
+
+    const std::string& Candidate::path() {
+        if (fullPath.empty()) {
+            if (directoryPath.empty()) {
+                fullPath = entryName;
+            } else if (directoryPath.back() == '/') {
+                fullPath = directoryPath + entryName;
+            } else {
+                fullPath = directoryPath + "/" + entryName;
+            }
+        }
+        return fullPath;
+    }
+
+    const struct stat* Candidate::status() {
+        if (statState == 0) {
+            statState = fstatat(dirfd, entryName.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 ? 1 : -1;
+        }
+        return statState == 1 ? &st : nullptr;
+    }
+
+    int cost(const Expression& expression) {
+        switch (expression.kind) {
+            case Kind::Name:
+            case Kind::Extension:
+            case Kind::Type:
+                return 0;                                   // straight from getdents64
+            case Kind::Regex:
+                return 1;                                   // builds the path
+            case Kind::Size:
+            case Kind::Age:
+            case Kind::Newer:
+            case Kind::Permissions:
+                return 2;                                   // one fstatat
+            default: {
+                int highest = 0;
+                for (const Expression& operand : expression.operands) {
+                    highest = std::max(highest, cost(operand));
+                }
+                return highest;
+            }
+        }
+    }
+
+    // Flattens nested and/or of the same kind and puts cheap operands first
+    Expression optimize(const Expression& expression) {
+        if (expression.kind != Kind::And && expression.kind != Kind::Or && expression.kind != Kind::Not) {
+            return expression;
+        }
+        Expression result = expression;
+        result.operands.clear();
+        for (const Expression& operand : expression.operands) {
+            Expression optimized = optimize(operand);
+            if (expression.kind != Kind::Not && optimized.kind == expression.kind) {
+                for (Expression& inner : optimized.operands) {
+                    result.operands.push_back(std::move(inner));
+                }
+            } else {
+                result.operands.push_back(std::move(optimized));
+            }
+        }
+        if (result.kind != Kind::Not) {
+            std::stable_sort(result.operands.begin(), result.operands.end(), [](const Expression& a, const Expression& b) {
+                return cost(a) < cost(b);
+            });
+        }
+        return result;
+    }
+
+    Program::Program() : now(time(nullptr)), statNeeded(false) {}
+
+    Program::Program(const Expression& expression) : now(time(nullptr)), statNeeded(false) {
+        Expression optimized = optimize(expression);
+        if (optimized.kind == Kind::And && optimized.operands.empty()) {
+            return;                                         // matches everything, leave the program empty
+        }
+        emit(optimized);
+        statNeeded = cost(optimized) >= 2;
+    }
+
+    void Program::emit(const Expression& expression) {
+        switch (expression.kind) {
+            case Kind::And:
+            case Kind::Or: {
+                bool isAnd = expression.kind == Kind::And;
+                if (expression.operands.empty()) {
+                    code.push_back({OpCode::Constant, isAnd ? 1u : 0u});
+                    return;
+                }
+                std::vector<size_t> jumps;
+                for (size_t i = 0; i < expression.operands.size(); ++i) {
+                    if (i > 0) {
+                        jumps.push_back(code.size());
+                        code.push_back({isAnd ? OpCode::JumpIfFalse : OpCode::JumpIfTrue, 0});
+                    }
+                    emit(expression.operands[i]);
+                }
+                for (size_t jump : jumps) {
+                    code[jump].operand = static_cast<uint32_t>(code.size());
+                }
+                return;
+            }
+            case Kind::Not:
+                emit(expression.operands[0]);
+                code.push_back({OpCode::Not, 0});
+                return;
+            default:
+                tests.push_back(expression);
+                code.push_back({OpCode::Test, static_cast<uint32_t>(tests.size() - 1)});
+                return;
+        }
+    }
+
+    bool compare_value(int64_t actual, int compare, int64_t value) {
+        return compare > 0 ? actual > value : compare < 0 ? actual < value : actual == value;
+    }
+
+    bool Program::run_test(const Expression& test, Candidate& candidate) const {
+        switch (test.kind) {
+            case Kind::Name:
+                return fnmatch(test.text.c_str(), candidate.name().c_str(), test.ignoreCase ? FNM_CASEFOLD : 0) == 0;
+            case Kind::Regex:
+                return regexec(static_cast<const regex_t*>(test.regex.get()), candidate.path().c_str(), 0, nullptr, 0) == 0;
+            case Kind::Extension: {
+                const std::string& entryName = candidate.name();
+                size_t dot = entryName.rfind('.');
+                return dot != std::string::npos && dot > 0 && entryName.compare(dot + 1, std::string::npos, test.text) == 0;
+            }
+            case Kind::Type:
+                return (test.mask & type_bit(candidate.type())) != 0;
+            default:
+                break;
+        }
+
+        const struct stat* st = candidate.status();
+        if (!st) {
+            return false;
+        }
+        switch (test.kind) {
+            case Kind::Size: {
+                int64_t bytes = static_cast<int64_t>(st->st_size);
+                return compare_value(test.unit == 1 ? bytes : (bytes + test.unit - 1) / test.unit, test.compare, test.value);
+            }
+            case Kind::Age: {
+                int64_t seconds = static_cast<int64_t>(now - st->st_mtime);
+                int64_t units = seconds >= 0 ? seconds / test.unit : -((-seconds + test.unit - 1) / test.unit);
+                return compare_value(units, test.compare, test.value);
+            }
+            case Kind::Newer:
+                return st->st_mtim.tv_sec > test.reference.tv_sec ||
+                       (st->st_mtim.tv_sec == test.reference.tv_sec && st->st_mtim.tv_nsec > test.reference.tv_nsec);
+            case Kind::Permissions: {
+                mode_t bits = st->st_mode & 07777;
+                switch (test.permissionMatch) {
+                    case PermissionMatch::Exact: return bits == test.mode;
+                    case PermissionMatch::All: return (bits & test.mode) == test.mode;
+                    case PermissionMatch::Any: return test.mode == 0 || (bits & test.mode) != 0;
+                }
+                return false;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool Program::matches(Candidate& candidate) const {
+        bool result = true;
+        for (size_t pc = 0; pc < code.size();) {
+            const Instruction& instruction = code[pc];
+            switch (instruction.op) {
+                case OpCode::Test:
+                    result = run_test(tests[instruction.operand], candidate);
+                    ++pc;
+                    break;
+                case OpCode::Not:
+                    result = !result;
+                    ++pc;
+                    break;
+                case OpCode::JumpIfFalse:
+                    pc = result ? pc + 1 : instruction.operand;
+                    break;
+                case OpCode::JumpIfTrue:
+                    pc = result ? instruction.operand : pc + 1;
+                    break;
+                case OpCode::Constant:
+                    result = instruction.operand != 0;
+                    ++pc;
+                    break;
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace predicate {
+    enum TypeMask : unsigned {
+        TYPE_FILE = 1,
+        TYPE_DIRECTORY = 2,
+        TYPE_SYMLINK = 4,
+        TYPE_FIFO = 8,
+        TYPE_SOCKET = 16,
+        TYPE_CHARACTER = 32,
+        TYPE_BLOCK = 64,
+        TYPE_OTHER = TYPE_FIFO | TYPE_SOCKET | TYPE_CHARACTER | TYPE_BLOCK
+    };
+
+    enum class Kind {
+        And,
+        Or,
+        Not,
+        Name,                       // glob on the last component
+        Regex,                      // POSIX extended regex on the whole path
+        Extension,
+        Type,
+        Size,                       // compares ceil(size / unit) with value
+        Age,                        // compares floor((now - mtime) / unit) with value
+        Newer,                      // mtime later than a reference time
+        Permissions
+    };
+
+    enum class PermissionMatch {
+        Exact,                      // -perm 644
+        All,                        // -perm -644, every bit set
+        Any                         // -perm /644, at least one bit set
+    };
+
+    // Parse tree of a filter. Build it with the helpers below or parse() and hand it to a Program.
+    struct Expression {
+        Kind kind = Kind::And;
+        std::vector<Expression> operands;           // And / Or / Not
+        std::string text;                           // pattern or extension
+        bool ignoreCase = false;
+        std::shared_ptr<void> regex;                // compiled regex_t
+        unsigned mask = 0;                          // TypeMask bits
+        int compare = 0;                            // -1 less than, 0 equal, 1 more than value
+        int64_t value = 0;
+        int64_t unit = 1;
+        struct timespec reference = {0, 0};
+        mode_t mode = 0;
+        PermissionMatch permissionMatch = PermissionMatch::Exact;
+    };
+
+    Expression all(std::vector<Expression> operands);           // true when empty
+    Expression any(std::vector<Expression> operands);           // false when empty
+    Expression negate(Expression operand);
+    Expression name(const std::string& pattern, bool ignoreCase = false);
+    bool regex(const std::string& pattern, Expression& expression, std::string& error);
+    Expression extension(const std::string& extension);
+    Expression type(unsigned mask);
+    Expression size(int compare, int64_t value, int64_t unit = 1);
+    Expression age(int compare, int64_t value, int64_t unit = 1);
+    Expression newer(const struct timespec& reference);
+    Expression permissions(mode_t mode, PermissionMatch match);
+
+    // find syntax from words[position] on: tests, '!' / -not, -a / -and (or nothing), -o / -or,
+    // and '(' ')'. Stops at the first word that is not part of the expression.
+    bool parse(const std::vector<std::string>& words, size_t& position, Expression& expression, std::string& error);
+
+    // What a Program sees of one directory entry. The path and the stat are only produced when
+    // a test asks for them.
+    class Candidate {
+    public:
+        Candidate(int dirfd, const std::string& directoryPath, const std::string& name, unsigned char type);
+
+        const std::string& name() const { return entryName; }
+        unsigned char type() const { return entryType; }
+        const std::string& path();
+        const struct stat* status();                // nullptr if fstatat() failed
+
+    private:
+        int dirfd;
+        const std::string& directoryPath;
+        const std::string& entryName;
+        unsigned char entryType;
+        std::string fullPath;
+        struct stat st;
+        int statState;                              // 0 not yet, 1 done, -1 failed
+    };
+
+    // An Expression compiled to a flat list of tests and short circuit jumps. Within every and/or
+    // the operands are reordered cheapest first: name and type tests, then regexes on the path,
+    // then the ones that need a stat. None of the tests has side effects, so this keeps the meaning.
+    class Program {
+    public:
+        Program();
+        explicit Program(const Expression& expression);
+
+        bool matches(Candidate& candidate) const;
+        bool empty() const { return code.empty(); }
+        bool needs_stat() const { return statNeeded; }
+
+    private:
+        enum class OpCode : uint8_t {
+            Test,                   // result = tests[operand]
+            Not,
+            JumpIfFalse,            // to operand, keeping the result
+            JumpIfTrue,
+            Constant                // result = operand != 0
+        };
+
+        struct Instruction {
+            OpCode op;
+            uint32_t operand;
+        };
+
+        void emit(const Expression& expression);
+        bool run_test(const Expression& test, Candidate& candidate) const;
+
+        std::vector<Instruction> code;
+        std::vector<Expression> tests;
+        time_t now;
+        bool statNeeded;
+    };
+
+    unsigned type_bit(unsigned char dtype);
+}
+
+#endif // PREDICATE_H
@@ -0,0 +1,110 @@
+#include "progress.h"
+#include "base_tools.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace progress {
+    const auto REDRAW_INTERVAL = std::chrono::milliseconds(200);
+
+    double cpu_seconds(const struct timeval& time) {
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+    }
+
+    std::string format_duration(double seconds) {
+        long total = static_cast<long>(seconds + 0.5);
+        char buffer[32];
+        if (total >= 3600) {
+            snprintf(buffer, sizeof(buffer), "%ld:%02ld:%02ld", total / 3600, (total / 60) % 60, total % 60);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%ld:%02ld", total / 60, total % 60);
+        }
+        return buffer;
+    }
+
+    Meter::Meter(std::string label, Render render)
+        : label(std::move(label)), bytes(0), files(0), totalBytes(0), totalFiles(0),
+          started(std::chrono::steady_clock::now()), finished(false), stopping(false) {
+        getrusage(RUSAGE_SELF, &startUsage);
+        if (render == Render::Auto && isatty(STDERR_FILENO)) {
+            renderer = std::thread(&Meter::render_loop, this);
+        }
+    }
+
+    Meter::~Meter() {
+        if (!finished) {
+            finish();
+        }
+    }
+
+    void Meter::set_total(std::uintmax_t bytesTotal, std::uintmax_t filesTotal) {
+        totalBytes = bytesTotal;
+        totalFiles = filesTotal;
+    }
+
+    std::string Meter::status_line(double seconds) const {
+        std::uintmax_t doneBytes = bytes.load(std::memory_order_relaxed);
+        std::uintmax_t doneFiles = files.load(std::memory_order_relaxed);
+        std::uintmax_t allBytes = totalBytes.load(std::memory_order_relaxed);
+        std::string line = label + ": " + formatBytes(doneBytes);
+        if (allBytes > 0) {
+            line += " / " + formatBytes(allBytes);
+        }
+        char rates[64];
+        snprintf(rates, sizeof(rates), "  %.1f MB/s  %ju files  %.0f files/s",
+                 doneBytes / seconds / (1024 * 1024), doneFiles, doneFiles / seconds);
+        line += rates;
+        if (allBytes > 0 && doneBytes > 0 && doneBytes < allBytes) {
+            line += "  ETA " + format_duration(seconds * static_cast<double>(allBytes - doneBytes) / static_cast<double>(doneBytes));
+        }
+        return line;
+    }
+
+    void Meter::render_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop.wait_for(lock, REDRAW_INTERVAL, [this] { return stopping; })) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            std::string line = "\r\033[K" + status_line(seconds);
+            fputs(line.c_str(), stderr);
+            fflush(stderr);
+        }
+        fputs("\r\033[K", stderr);                          // leave the terminal as we found it
+        fflush(stderr);
+    }
+
+    void Meter::finish(const std::vector<std::pair<std::string, std::string>>& extra) {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        if (renderer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            stop.notify_all();
+            renderer.join();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double user = cpu_seconds(usage.ru_utime) - cpu_seconds(startUsage.ru_utime);
+        double system = cpu_seconds(usage.ru_stime) - cpu_seconds(startUsage.ru_stime);
+        double wall = std::max(seconds, 1e-6);
+        std::uintmax_t doneBytes = bytes;
+        std::uintmax_t doneFiles = files;
+
+        char summary[256];
+        snprintf(summary, sizeof(summary),
+                 "%s: summary bytes=%ju files=%ju seconds=%.3f mb_per_s=%.1f files_per_s=%.0f cpu_user=%.3f cpu_sys=%.3f cpu_pct=%.0f",
+                 label.c_str(), doneBytes, doneFiles, seconds, doneBytes / wall / (1024 * 1024), doneFiles / wall,
+                 user, system, 100 * (user + system) / wall);
+        std::string line = summary;
+        for (const auto& pair : extra) {
+            line += " " + pair.first + "=" + pair.second;
+        }
+        fprintf(stderr, "%s\n", line.c_str());
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace progress {
+    enum class Render {
+        Auto,                       // status line on stderr when it is a terminal
+        Never                       // e.g. when the builtin's own output is on that terminal
+    };
+
+    // Shared counters for long-running builtins. Workers bump the atomics; a render thread,
+    // started only when there is a terminal to draw on, redraws the status line a few times a
+    // second. finish() prints one key=value summary line including CPU time, so it can be told
+    // whether the run was I/O bound (low cpu_pct) or CPU bound (cpu_pct near 100 per thread).
+    class Meter {
+    public:
+        explicit Meter(std::string label, Render render = Render::Auto);
+        ~Meter();
+        Meter(const Meter&) = delete;
+        Meter& operator=(const Meter&) = delete;
+
+        void add_bytes(std::uintmax_t count) { bytes.fetch_add(count, std::memory_order_relaxed); }
+        void add_files(std::uintmax_t count = 1) { files.fetch_add(count, std::memory_order_relaxed); }
+        void set_total(std::uintmax_t totalBytes, std::uintmax_t totalFiles = 0);
+
+        // Stops the status line and prints the summary, with extra key=value pairs appended
+        void finish(const std::vector<std::pair<std::string, std::string>>& extra = {});
+
+    private:
+        void render_loop();
+        std::string status_line(double seconds) const;
+
+        std::string label;
+        std::atomic<std::uintmax_t> bytes;
+        std::atomic<std::uintmax_t> files;
+        std::atomic<std::uintmax_t> totalBytes;
+        std::atomic<std::uintmax_t> totalFiles;
+        std::chrono::steady_clock::time_point started;
+        struct rusage startUsage;
+        bool finished;
+        bool stopping;
+        std::mutex mutex;
+        std::condition_variable stop;
+        std::thread renderer;
+    };
+
+    std::string format_duration(double seconds);
+}
+
+#endif // PROGRESS_H
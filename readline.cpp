@@ -1,11 +1,176 @@
 #include "readline.h"
 #include "base_tools.h"
+#include "JobHandler.h"
+#include "dir_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <sys/stat.h>
 
 namespace fs = std::filesystem;
 
 vector<string> history;
 struct termios orig_termios;
 
+// Blocks until a key is available, reporting background jobs that finish while the user is idle
+static bool waitForKey(const string &prompt, const string &line, int column)
+{
+    struct pollfd fds[2];
+    fds[0] = {STDIN_FILENO, POLLIN, 0};
+    fds[1] = {jobEventFd(), POLLIN, 0};
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return true; // let read() report the error
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            cout << "\033[2K\r";
+            notifyJobs();
+            cout << prompt << line;
+            cout << "\033[" << column << "G";
+            cout.flush();
+        }
+
+        if (fds[0].revents)
+        {
+            return true;
+        }
+    }
+}
+
+// Tab: completes the word before the cursor against the cached listing of its directory.
+// One match is inserted in full, several are extended to their common prefix and listed
+// below the prompt once nothing more can be added.
+static void completeWord(string &line, int &cursorPos, const string &prompt, int length)
+{
+    size_t start = cursorPos;
+    while (start > 0 && line[start - 1] != ' ')
+    {
+        start--;
+    }
+    string word = line.substr(start, cursorPos - start);
+    bool quoted = !word.empty() && word[0] == '"';
+    if (quoted)
+    {
+        word.erase(0, 1);
+    }
+
+    size_t slash = word.rfind('/');
+    string directory = slash == string::npos ? "" : word.substr(0, slash + 1);
+    string prefix = slash == string::npos ? word : word.substr(slash + 1);
+    string lookupPath = directory.empty() ? "." : directory;
+    if (lookupPath[0] == '~')
+    {
+        lookupPath.replace(0, 1, get_vars::get_HOME_var());
+    }
+
+    dir_cache::Snapshot snapshot = dir_cache::lookup(lookupPath);
+    if (!snapshot)
+    {
+        cout << '\a';
+        cout.flush();
+        return;
+    }
+
+    // The snapshot is sorted by name, so the matches form one contiguous run
+    auto first = lower_bound(snapshot->begin(), snapshot->end(), prefix,
+                             [](const walker::Entry &entry, const string &value) { return entry.name < value; });
+    vector<const walker::Entry*> matches;
+    for (auto it = first; it != snapshot->end() && it->name.compare(0, prefix.size(), prefix) == 0; ++it)
+    {
+        if (it->name[0] == '.' && (prefix.empty() || prefix[0] != '.'))
+        {
+            continue;
+        }
+        matches.push_back(&*it);
+    }
+
+    auto isDirectory = [&lookupPath](const walker::Entry &entry)
+    {
+        if (entry.type == DT_DIR)
+        {
+            return true;
+        }
+        struct stat st;
+        string path = lookupPath + "/" + entry.name;
+        return (entry.type == DT_LNK || entry.type == DT_UNKNOWN) && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    };
+
+    string insertion;
+    if (matches.empty())
+    {
+        cout << '\a';
+        cout.flush();
+        return;
+    }
+    else if (matches.size() == 1)
+    {
+        const string &name = matches[0]->name;
+        bool directoryMatch = isDirectory(*matches[0]);
+        if (!quoted && name.find(' ') != string::npos)
+        {
+            line.insert(start, 1, '"');           // the shell splits on spaces
+            cursorPos++;
+            quoted = true;
+        }
+        insertion = name.substr(prefix.size());
+        if (directoryMatch)
+        {
+            insertion += '/';
+        }
+        else
+        {
+            insertion += quoted ? "\" " : " ";
+        }
+    }
+    else
+    {
+        string common = matches.front()->name;
+        for (const walker::Entry *entry : matches)
+        {
+            size_t n = 0;
+            while (n < common.size() && n < entry->name.size() && common[n] == entry->name[n])
+            {
+                n++;
+            }
+            common.resize(n);
+        }
+        insertion = common.substr(prefix.size());
+
+        if (insertion.empty())
+        {
+            const size_t LIMIT = 200;
+            string listing = "\n";
+            for (size_t i = 0; i < matches.size() && i < LIMIT; ++i)
+            {
+                listing += matches[i]->name;
+                listing += isDirectory(*matches[i]) ? "/  " : "  ";
+            }
+            if (matches.size() > LIMIT)
+            {
+                listing += "... (" + to_string(matches.size() - LIMIT) + " more)";
+            }
+            cout << listing << "\n";
+        }
+    }
+
+    line.insert(cursorPos, insertion);
+    cursorPos += insertion.size();
+    cout << "\033[2K\r" << prompt << line;
+    cout << "\033[" << (cursorPos + length) << "G";
+    cout.flush();
+}
+
 void SimpleReadline::enableRawMode()
 {
     tcgetattr(STDIN_FILENO, &orig_termios);
@@ -57,10 +222,11 @@ string SimpleReadline::readLine()
 
     int cursorPos = 0;
     int historyIndex = history.size();
+    notifyJobs();
     cout << prompt;
     cout.flush();
 
-    while (read(STDIN_FILENO, &c, 1) == 1 && c != '\n')
+    while (waitForKey(prompt, line, cursorPos + length) && read(STDIN_FILENO, &c, 1) == 1 && c != '\n')
     {
         // functions
         if (c == '\033')
@@ -218,6 +384,14 @@ string SimpleReadline::readLine()
             continue;
         }
 
+        // Tab completion
+        if (c == '\t')
+        {
+            completeWord(line, cursorPos, prompt, length);
+
+            continue;
+        }
+
         // if CTRL+D is pressed return exit
         if (c == 4)
         {
@@ -232,7 +406,6 @@ string SimpleReadline::readLine()
             c == 6 ||   // CTRL+F
             c == 7 ||   // CTRL+G
             c == 8 ||   // CTRL+H
-            c == 9 ||   // CTRL+I
             c == 11 ||  // CTRL+K
             c == 12 ||  // CTRL+L
             c == 14 ||  // CTRL+N
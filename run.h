@@ -2,12 +2,30 @@
 #define RUN_H
 
 #include <cstring>
+#include <sched.h>
 #include <spawn.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <string>
 #include <future>
+#include <utility>
 #include <vector>
 
+struct LaunchAttrs {                // per command placement, applied in the child before exec
+    bool hasCpus = false;
+    cpu_set_t cpus;
+    bool hasNice = false;
+    int nice = 0;
+    bool hasPolicy = false;
+    int policy = SCHED_OTHER;
+    int priority = 0;
+    std::vector<std::pair<int, struct rlimit>> limits;
+};
+
+bool parseLaunchArgs(const std::vector<std::string>& args, LaunchAttrs& attrs, size_t& commandStart);
+bool applyLaunchAttrs(const LaunchAttrs& attrs);
+void run(const std::vector<std::string>& args);
+
 std::future<void> wine(const std::vector<std::string>& args);
 std::future<void> runBinaryAsync_with_env(const std::string& binaryPath);
 std::future<void> runBinaryAsync_with_env_wargs(const std::string& binaryPath, const std::vector<std::string>& args);
@@ -1,6 +1,10 @@
 #include "base_tools.h"
+#include "JobHandler.h"
 #include "run.h"
 
+#include <cctype>
+#include <cerrno>
+#include <climits>
 
 namespace tools {
     std::string dll(const std::string& full_parh_to_dll){
@@ -81,7 +85,7 @@ std::future<void> wine(const std::vector<std::string> &args) {
         int status;
         if (posix_spawn(&pid, "/bin/wine64", &actions, &attr, argvPtr, envp) == 0) {
             // Wait for the child process to finish
-            waitpid(pid, &status, 0);
+            waitForegroundJob(pid, joinArgs(args), &status);
         } else {
             throw std::runtime_error("Error spawning the process: " + std::string(strerror(errno)));
         }
@@ -131,18 +135,18 @@ std::future<void> runBinaryAsync_with_env(const std::string& binaryPath) {
         posix_spawnattr_t attr;
         posix_spawn_file_actions_t actions;
 
-        posix_spawnattr_setschedpolicy(&attr, SCHED_FIFO);
-
         posix_spawn_file_actions_init(&actions);
         posix_spawnattr_init(&attr);
 
-
         int status;
-        if (posix_spawn(&pid, binaryPath.c_str(), nullptr, nullptr, argv, envp) == 0) {
+        int result = posix_spawn(&pid, binaryPath.c_str(), &actions, &attr, argv, envp);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        if (result == 0) {
             // Wait for the child process to finish
-            waitpid(pid, &status, 0);
+            waitForegroundJob(pid, binaryPath, &status);
         } else {
-            throw std::runtime_error("Error spawning the process: " + std::string(strerror(errno)));
+            throw std::runtime_error("Error spawning the process: " + std::string(strerror(result)));
         }
     });
 }
@@ -213,7 +217,7 @@ std::future<void> runBinaryAsync_with_env_wargs(const std::string& binaryPath, c
         int status;
         if (posix_spawn(&pid, binaryPath.c_str(), &actions, &attr, argvPtr, envp) == 0) {
             // Wait for the child process to finish
-            waitpid(pid, &status, 0);
+            waitForegroundJob(pid, joinArgs(args), &status);
         } else {
             throw std::runtime_error("Error spawning the process: " + std::string(strerror(errno)));
         }
@@ -240,11 +244,229 @@ void og(std::vector<std::string>& args) {
             }
         } else {                                        // This is the parent process
             int status;
-            if (waitpid(pid, &status, 0) == -1) {       // Wait for the child to finish
+            if (waitForegroundJob(pid, joinArgs(newArgs), &status) == -1) {       // Wait for the child to finish
                 perror("waitpid");
             }
         }
 }
+namespace {
+    bool parseCpuList(const std::string& list, cpu_set_t& cpus) {      // "0-3,8,10-11"
+        CPU_ZERO(&cpus);
+        for (const std::string& range : splitString(list, ',')) {
+            size_t dash = range.find('-');
+            if (range.empty() || !isdigit(static_cast<unsigned char>(range[0]))) {
+                return false;
+            }
+            char* end = nullptr;
+            long first = std::strtol(range.c_str(), &end, 10);
+            long last = first;
+            if (dash != std::string::npos) {
+                if (end != range.c_str() + dash || !isdigit(static_cast<unsigned char>(range[dash + 1]))) {
+                    return false;                       // "3x-5", "2-"
+                }
+                last = std::strtol(range.c_str() + dash + 1, &end, 10);
+            }
+            if (*end != '\0' || last < first || last >= CPU_SETSIZE) {
+                return false;
+            }
+            for (long cpu = first; cpu <= last; ++cpu) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        return true;
+    }
+
+    bool parseInteger(const std::string& text, long low, long high, int& value) {
+        char* end = nullptr;
+        errno = 0;
+        long number = std::strtol(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno == ERANGE || number < low || number > high) {
+            return false;
+        }
+        value = static_cast<int>(number);
+        return true;
+    }
+
+    // Suffixes only for byte limits; counts and seconds take plain numbers
+    bool parseLimit(const std::string& text, bool bytes, rlim_t& value) {      // "4G", "512M", "unlimited"
+        if (text == "unlimited") {
+            value = RLIM_INFINITY;
+            return true;
+        }
+        if (text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) {
+            return false;                               // strtoull would take "-1" as 2^64-1
+        }
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long number = std::strtoull(text.c_str(), &end, 10);
+        if (errno == ERANGE) {
+            return false;
+        }
+        int shift = 0;
+        if (bytes) {
+            switch (*end) {
+                case 'K': case 'k': shift = 10; break;
+                case 'M': case 'm': shift = 20; break;
+                case 'G': case 'g': shift = 30; break;
+                case 'T': case 't': shift = 40; break;
+                default: break;
+            }
+        }
+        if (shift != 0) {
+            ++end;
+        }
+        if (*end != '\0' || number > (ULLONG_MAX >> shift)) {
+            return false;
+        }
+        value = static_cast<rlim_t>(number << shift);
+        return true;
+    }
+
+    bool parsePolicy(const std::string& name, int& policy) {
+        if (name == "other") policy = SCHED_OTHER;
+        else if (name == "batch") policy = SCHED_BATCH;
+        else if (name == "idle") policy = SCHED_IDLE;
+        else if (name == "fifo") policy = SCHED_FIFO;
+        else if (name == "rr") policy = SCHED_RR;
+        else return false;
+        return true;
+    }
+
+    void run_usage() {
+        std::cout << "Usage: run [options] <command> [args...]\n"
+                     "  --cpus <list>      pin to CPUs, e.g. 0-3,8\n"
+                     "  --nice <n>         nice value (-20..19)\n"
+                     "  --sched <policy>   other, batch, idle, fifo or rr\n"
+                     "  --prio <n>         priority for fifo/rr\n"
+                     "  --mem <size>       address space limit, e.g. 4G\n"
+                     "  --nofile <n>       open file limit\n"
+                     "  --cpu-time <sec>   CPU time limit\n"
+                     "  --procs <n>        process limit\n";
+    }
+}
+
+bool parseLaunchArgs(const std::vector<std::string>& args, LaunchAttrs& attrs, size_t& commandStart) {
+    size_t i = 1;
+    bool priority = false;
+    for (; i < args.size() && args[i].compare(0, 2, "--") == 0; i += 2) {
+        const std::string& flag = args[i];
+        if (flag == "--") {
+            ++i;
+            break;
+        }
+        if (i + 1 >= args.size()) {
+            error_message_no_halt("run", "'" + flag + "' needs a value");
+            return false;
+        }
+        const std::string& value = args[i + 1];
+        rlim_t limit = 0;
+        if (flag == "--cpus") {
+            if (!parseCpuList(value, attrs.cpus)) {
+                error_message_no_halt("run", "invalid CPU list '" + value + "'");
+                return false;
+            }
+            attrs.hasCpus = true;
+        } else if (flag == "--nice") {
+            if (!parseInteger(value, -20, 19, attrs.nice)) {
+                error_message_no_halt("run", "invalid nice value '" + value + "'");
+                return false;
+            }
+            attrs.hasNice = true;
+        } else if (flag == "--sched") {
+            if (!parsePolicy(value, attrs.policy)) {
+                error_message_no_halt("run", "unknown scheduling policy '" + value + "'");
+                return false;
+            }
+            attrs.hasPolicy = true;
+        } else if (flag == "--prio") {
+            if (!parseInteger(value, 0, 99, attrs.priority)) {
+                error_message_no_halt("run", "invalid priority '" + value + "'");
+                return false;
+            }
+            priority = true;
+        } else if (flag == "--mem" || flag == "--nofile" || flag == "--cpu-time" || flag == "--procs") {
+            if (!parseLimit(value, flag == "--mem", limit)) {
+                error_message_no_halt("run", "invalid limit '" + value + "'");
+                return false;
+            }
+            int resource = (flag == "--mem") ? RLIMIT_AS : (flag == "--nofile") ? RLIMIT_NOFILE : (flag == "--cpu-time") ? RLIMIT_CPU : RLIMIT_NPROC;
+            attrs.limits.push_back({resource, {limit, limit}});
+        } else {
+            error_message_no_halt("run", "unknown option '" + flag + "'");
+            return false;
+        }
+    }
+    bool realtime = attrs.hasPolicy && (attrs.policy == SCHED_FIFO || attrs.policy == SCHED_RR);
+    if (priority && !realtime) {
+        error_message_no_halt("run", "'--prio' needs '--sched fifo' or '--sched rr'");
+        return false;
+    }
+    if (realtime && attrs.priority == 0) {
+        attrs.priority = sched_get_priority_min(attrs.policy);
+    }
+    commandStart = i;
+    return true;
+}
+
+// Runs in the forked child, so it only makes plain syscalls
+bool applyLaunchAttrs(const LaunchAttrs& attrs) {
+    for (const auto& limit : attrs.limits) {
+        if (setrlimit(limit.first, &limit.second) != 0) {
+            return false;
+        }
+    }
+    if (attrs.hasCpus && sched_setaffinity(0, sizeof(attrs.cpus), &attrs.cpus) != 0) {
+        return false;
+    }
+    if (attrs.hasPolicy) {
+        struct sched_param param = {};
+        param.sched_priority = attrs.priority;
+        if (sched_setscheduler(0, attrs.policy, &param) != 0) {
+            return false;
+        }
+    }
+    if (attrs.hasNice && setpriority(PRIO_PROCESS, 0, attrs.nice) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void run(const std::vector<std::string>& args) {
+    LaunchAttrs attrs;
+    size_t commandStart = 0;
+    if (!parseLaunchArgs(args, attrs, commandStart)) {
+        return;
+    }
+    if (commandStart >= args.size()) {
+        run_usage();
+        return;
+    }
+    std::vector<std::string> command(args.begin() + commandStart, args.end());
+    char** argv = vectorToArgv(command);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+    } else if (pid == 0) {
+        if (!applyLaunchAttrs(attrs)) {
+            perror("run");
+            _exit(EXIT_FAILURE);
+        }
+        execvp(argv[0], argv);
+        if (errno == ENOENT) {
+            std::cerr << "Shell: '" << command[0] << "' no such file or directory\n";
+        } else {
+            perror("execvp");
+        }
+        _exit(EXIT_FAILURE);
+    } else {
+        int status;
+        if (waitForegroundJob(pid, joinArgs(command), &status) == -1) {
+            perror("waitpid");
+        }
+    }
+    cleanUpArgv(argv);
+}
+
 void run_from_current_dir(std::vector<std::string>& args) {
     size_t pos = args[0].find("./");
     if (pos != std::string::npos) {
@@ -1139,4 +1139,84 @@ namespace string_manipulation
             targetstring = result;
         }
     }
+
+    struct CodepointRange
+    {
+        char32_t first;
+        char32_t last;
+    };
+
+    const CodepointRange ZERO_WIDTH[] =
+    {
+        {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x065F},
+        {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F},
+        {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    };
+
+    const CodepointRange DOUBLE_WIDTH[] =
+    {
+        {0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF},
+        {0xA000, 0xA4CF}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE30, 0xFE4F}, {0xFF00, 0xFF60},
+        {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F}, {0x1F900, 0x1F9FF}, {0x20000, 0x3FFFD},
+    };
+
+    template <size_t N>
+    bool in_ranges(const CodepointRange (&ranges)[N], char32_t codepoint)
+    {
+        for (const CodepointRange& range : ranges)
+        {
+            if (codepoint < range.first)
+            {
+                return false;                               // ranges are sorted
+            }
+            if (codepoint <= range.last)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t display_width(const std::string& text)
+    {
+        size_t width = 0;
+        for (size_t i = 0; i < text.size();)
+        {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c == 0x1b && i + 1 < text.size() && text[i + 1] == '[')
+            {
+                i += 2;                                     // CSI sequence, e.g. a color
+                while (i < text.size() && !(text[i] >= 0x40 && text[i] <= 0x7e)) ++i;
+                ++i;
+                continue;
+            }
+            if (c < 0x80)
+            {
+                width += 1;
+                ++i;
+                continue;
+            }
+            size_t length = (c >= 0xf0) ? 4 : (c >= 0xe0) ? 3 : (c >= 0xc0) ? 2 : 1;
+            char32_t codepoint = (length == 1) ? c : (c & (0x7f >> length));
+            bool valid = length > 1 && i + length <= text.size();
+            for (size_t k = 1; valid && k < length; ++k)
+            {
+                unsigned char next = static_cast<unsigned char>(text[i + k]);
+                valid = (next & 0xc0) == 0x80;
+                codepoint = (codepoint << 6) | (next & 0x3f);
+            }
+            if (!valid)
+            {
+                width += 1;                                 // stray byte, the terminal shows a replacement
+                ++i;
+                continue;
+            }
+            if (!in_ranges(ZERO_WIDTH, codepoint))
+            {
+                width += in_ranges(DOUBLE_WIDTH, codepoint) ? 2 : 1;
+            }
+            i += length;
+        }
+        return width;
+    }
 }
@@ -14,6 +14,8 @@ namespace string_manipulation   {
     void color_for_string_no_comments_or_quotes(std::string& targetstring, const std::string& search_string, const std::string& color);
     void color_for_string_no_comments_or_quotes_bold(std::string& targetstring, const std::string& search_string, const std::string& color);
     void color_simple(std::string& targetstring, const std::string& search_string, const std::string& color);
+    // Terminal columns taken by a UTF-8 string: wide CJK/emoji count 2, combining marks and escape sequences 0
+    size_t display_width(const std::string& text);
     namespace make_color {
         void green_char(std::string& targetstring);
         void blue_char(std::string& targetstring, const char c);
@@ -0,0 +1,123 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+thread_local TaskPool* TaskPool::currentPool = nullptr;
+thread_local unsigned TaskPool::currentWorker = 0;
+
+unsigned TaskPool::default_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+TaskPool::TaskPool(unsigned threadCount, size_t maxQueued)
+    : pending(0), queued(0), nextWorker(0), maxQueued(maxQueued), stopping(false) {
+    if (threadCount == 0) {
+        threadCount = default_threads();
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back(&TaskPool::run, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned TaskPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+void TaskPool::submit(std::function<void()> task) {
+    unsigned target;
+    if (currentPool == this) {                              // tasks spawned by tasks stay local and never block
+        target = currentWorker;
+    } else {
+        if (maxQueued > 0) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            space.wait(lock, [this] { return queued.load() < maxQueued; });
+        }
+        target = nextWorker++ % workers.size();
+    }
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);      // pairs with the predicate check in run()
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool TaskPool::take(unsigned self, std::function<void()>& task) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::run(unsigned self) {
+    currentPool = this;
+    currentWorker = self;
+    while (true) {
+        std::function<void()> task;
+        if (take(self, task)) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                queued--;
+            }
+            if (maxQueued > 0) {
+                space.notify_all();
+            }
+            try {
+                task();
+            } catch (const std::exception& e) {
+                std::cerr << "TaskPool: task failed: " << e.what() << "\n";
+            }
+            task = nullptr;                                 // release captured resources before reporting done
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return queued.load() > 0 || stopping; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void TaskPool::wait() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this] { return pending.load() == 0; });
+}
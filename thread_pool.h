@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool: every worker pops the newest task from its own deque (depth first) and
+// steals the oldest task from the others when it runs dry. With maxQueued set, submit() from
+// outside the pool blocks while that many tasks are waiting, which bounds memory and open fds.
+class TaskPool {
+public:
+    explicit TaskPool(unsigned threads = 0, size_t maxQueued = 0);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    void submit(std::function<void()> task);
+    void wait();                    // until every submitted task, and what they submitted, is done
+    unsigned size() const;
+
+    static unsigned default_threads();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(unsigned self, std::function<void()>& task);
+    void run(unsigned self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::condition_variable space;
+    std::atomic<size_t> pending;    // submitted and not finished
+    std::atomic<size_t> queued;     // sitting in a deque
+    std::atomic<unsigned> nextWorker;
+    size_t maxQueued;
+    bool stopping;
+
+    static thread_local TaskPool* currentPool;
+    static thread_local unsigned currentWorker;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,299 @@
+#include "uring_io.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace uring_io {
+    const Op ALL_OPS[] = {Op::OpenAt, Op::Statx, Op::Read, Op::Write, Op::Fsync, Op::Close};
+
+    unsigned char opcode(Op op) {
+        switch (op) {
+            case Op::OpenAt: return IORING_OP_OPENAT;
+            case Op::Statx: return IORING_OP_STATX;
+            case Op::Read: return IORING_OP_READ;
+            case Op::Write: return IORING_OP_WRITE;
+            case Op::Fsync: return IORING_OP_FSYNC;
+            case Op::Close: return IORING_OP_CLOSE;
+        }
+        return IORING_OP_NOP;
+    }
+
+    // A request in a chain counts as failed if it errors or moves fewer bytes than asked
+    bool completed(const Request& request) {
+        if (request.result < 0) {
+            return false;
+        }
+        if (request.op == Op::Read || request.op == Op::Write) {
+            return request.result == static_cast<long>(request.length);
+        }
+        return true;
+    }
+
+    long execute(const Request& request) {
+        long result = -1;
+        switch (request.op) {
+            case Op::OpenAt:
+                result = openat(request.fd, request.path, request.flags, request.mode);
+                break;
+            case Op::Statx:
+                result = statx(request.fd, request.path, request.flags, request.length, static_cast<struct statx*>(request.buffer));
+                break;
+            case Op::Read:
+                do {
+                    result = pread(request.fd, request.buffer, request.length, request.offset);
+                } while (result < 0 && errno == EINTR);
+                break;
+            case Op::Write:
+                do {
+                    result = pwrite(request.fd, request.buffer, request.length, request.offset);
+                } while (result < 0 && errno == EINTR);
+                break;
+            case Op::Fsync:
+                result = fsync(request.fd);
+                break;
+            case Op::Close:
+                result = close(request.fd);
+                break;
+        }
+        return result < 0 ? -errno : result;
+    }
+
+    Ring::Ring(unsigned entries, unsigned fallbackThreads)
+        : ringFd(-1), sqEntries(0), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0),
+          sqes(MAP_FAILED), sqesSize(0), sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+          cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr), fallbackThreads(fallbackThreads) {
+        if (!setup(entries)) {
+            if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+            if (ringFd >= 0) close(ringFd);
+            ringFd = -1;
+        }
+    }
+
+    Ring::~Ring() {
+        if (ringFd >= 0) {
+            munmap(sqes, sqesSize);
+            if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+            munmap(sqRing, sqRingSize);
+            close(ringFd);
+        }
+    }
+
+    bool Ring::native() const {
+        return ringFd >= 0;
+    }
+
+    bool Ring::setup(unsigned entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            return false;                                   // ENOSYS, or disabled by sysctl/seccomp
+        }
+
+        // Every opcode we issue has to be known to this kernel, otherwise use syscalls throughout
+        std::vector<char> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        for (Op op : ALL_OPS) {
+            unsigned char code = opcode(op);
+            if (code > probe->last_op || !(probe->ops[code].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+
+        sqEntries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = single ? sqRing
+                        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = cq + params.cq_off.cqes;
+        return true;
+    }
+
+    void Ring::run(std::vector<Request>& requests) {
+        if (!native()) {
+            run_fallback(requests);
+            return;
+        }
+        size_t begin = 0;
+        while (begin < requests.size()) {
+            // Fill the ring as far as possible without splitting a linked chain
+            size_t end = begin;
+            size_t limit = std::min(requests.size(), begin + sqEntries);
+            for (size_t i = begin; i < limit; ++i) {
+                if (!requests[i].linkNext) {
+                    end = i + 1;
+                }
+            }
+            if (end == begin) {
+                end = begin + 1;                            // chain longer than the ring, run it by hand
+                while (end < requests.size() && requests[end - 1].linkNext) ++end;
+                std::vector<Request> chain(requests.begin() + begin, requests.begin() + end);
+                run_fallback(chain);
+                std::copy(chain.begin(), chain.end(), requests.begin() + begin);
+            } else {
+                run_native(requests, begin, end);
+            }
+            begin = end;
+        }
+    }
+
+    void Ring::run_native(std::vector<Request>& requests, size_t begin, size_t end) {
+        unsigned tail = *sqTail;
+        auto* entries = static_cast<io_uring_sqe*>(sqes);
+        for (size_t i = begin; i < end; ++i) {
+            const Request& request = requests[i];
+            unsigned index = tail & *sqMask;
+            io_uring_sqe& sqe = entries[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode(request.op);
+            sqe.fd = request.fd;
+            sqe.user_data = i;
+            if (request.linkNext) {
+                sqe.flags = IOSQE_IO_LINK;
+            }
+            switch (request.op) {
+                case Op::OpenAt:
+                    sqe.addr = reinterpret_cast<uintptr_t>(request.path);
+                    sqe.len = request.mode;
+                    sqe.open_flags = static_cast<__u32>(request.flags);
+                    break;
+                case Op::Statx:
+                    sqe.addr = reinterpret_cast<uintptr_t>(request.path);
+                    sqe.len = request.length;
+                    sqe.off = reinterpret_cast<uintptr_t>(request.buffer);
+                    sqe.statx_flags = static_cast<__u32>(request.flags);
+                    break;
+                case Op::Read:
+                case Op::Write:
+                    sqe.addr = reinterpret_cast<uintptr_t>(request.buffer);
+                    sqe.len = request.length;
+                    sqe.off = static_cast<__u64>(request.offset);
+                    break;
+                case Op::Fsync:
+                case Op::Close:
+                    break;
+            }
+            sqArray[index] = index;
+            ++tail;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        unsigned toSubmit = static_cast<unsigned>(end - begin);
+        unsigned remaining = toSubmit;
+        std::vector<char> reaped(end - begin, 0);
+        auto reap = [&] {
+            unsigned head = *cqHead;
+            unsigned cqTailNow = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            auto* completions = static_cast<io_uring_cqe*>(cqes);
+            for (; head != cqTailNow; ++head) {
+                const io_uring_cqe& cqe = completions[head & *cqMask];
+                requests[cqe.user_data].result = cqe.res;
+                reaped[cqe.user_data - begin] = 1;
+                --remaining;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        };
+        while (remaining > 0) {
+            long entered = syscall(__NR_io_uring_enter, ringFd, toSubmit, remaining, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(entered));
+            reap();
+        }
+        if (remaining > 0) {
+            // The ring itself failed. What was submitted still reads and writes the caller's
+            // buffers, so wait for it before tearing down; only the rest is failed by hand.
+            int error = errno;
+            while (remaining > toSubmit) {
+                long waited = syscall(__NR_io_uring_enter, ringFd, 0, remaining - toSubmit, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (waited < 0 && errno != EINTR) break;
+                reap();
+            }
+            for (size_t i = begin; i < end; ++i) {
+                if (!reaped[i - begin]) {
+                    requests[i].result = -error;
+                }
+            }
+            close(ringFd);
+            munmap(sqes, sqesSize);
+            if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+            munmap(sqRing, sqRingSize);
+            ringFd = -1;
+        }
+    }
+
+    void Ring::run_fallback(std::vector<Request>& requests) {
+        auto run_chain = [&requests](size_t begin, size_t end) {
+            bool broken = false;
+            for (size_t i = begin; i < end; ++i) {
+                if (broken) {
+                    requests[i].result = -ECANCELED;
+                    continue;
+                }
+                requests[i].result = execute(requests[i]);
+                broken = requests[i].linkNext && !completed(requests[i]);
+            }
+        };
+        if (fallbackThreads > 0 && !pool) {
+            pool = std::make_unique<TaskPool>(fallbackThreads);
+        }
+        size_t begin = 0;
+        while (begin < requests.size()) {
+            size_t end = begin + 1;
+            while (end < requests.size() && requests[end - 1].linkNext) ++end;
+            if (pool) {
+                pool->submit([run_chain, begin, end] { run_chain(begin, end); });
+            } else {
+                run_chain(begin, end);
+            }
+            begin = end;
+        }
+        if (pool) {
+            pool->wait();
+        }
+    }
+
+    Ring& thread_ring() {
+        thread_local Ring ring;
+        return ring;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <cstdint>
+#include <fcntl.h>
+#include <memory>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+class TaskPool;
+
+namespace uring_io {
+    enum class Op {
+        OpenAt,
+        Statx,
+        Read,
+        Write,
+        Fsync,
+        Close
+    };
+
+    struct Request {
+        Op op;
+        int fd = -1;                    // dirfd for OpenAt/Statx
+        const char* path = nullptr;
+        int flags = 0;                  // open flags, or AT_* flags for Statx
+        mode_t mode = 0;
+        void* buffer = nullptr;         // Read/Write data, or the struct statx for Statx
+        unsigned length = 0;            // bytes for Read/Write, mask for Statx
+        off_t offset = 0;
+        bool linkNext = false;          // the next request only runs if this one completes in full
+        long result = 0;                // return value, or -errno; -ECANCELED if an earlier link failed
+    };
+
+    // Runs batches of requests through io_uring, or through plain syscalls when the kernel
+    // has no io_uring (or lacks one of the opcodes). A Ring is not shared between threads.
+    class Ring {
+    public:
+        // fallbackThreads == 0 runs the fallback on the calling thread, which is what callers
+        // that are already pool workers want.
+        explicit Ring(unsigned entries = 256, unsigned fallbackThreads = 0);
+        ~Ring();
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+
+        bool native() const;
+        // Submits every request and returns once all of them have completed
+        void run(std::vector<Request>& requests);
+
+    private:
+        bool setup(unsigned entries);
+        void run_native(std::vector<Request>& requests, size_t begin, size_t end);
+        void run_fallback(std::vector<Request>& requests);
+
+        int ringFd;
+        unsigned sqEntries;
+        void* sqRing;
+        void* cqRing;
+        size_t sqRingSize;
+        size_t cqRingSize;
+        void* sqes;
+        size_t sqesSize;
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned* sqMask;
+        unsigned* sqArray;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned* cqMask;
+        void* cqes;
+        unsigned fallbackThreads;
+        std::unique_ptr<TaskPool> pool;
+    };
+
+    // Executes one request with the equivalent syscall
+    long execute(const Request& request);
+    // One ring per thread, created on first use
+    Ring& thread_ring();
+}
+
+#endif // URING_IO_H
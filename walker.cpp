@@ -0,0 +1,167 @@
+#include "walker.h"
+#include "base_tools.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace walker {
+    const size_t GETDENTS_BUFFER = 64 * 1024;
+
+    struct linux_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    FdHandle::FdHandle(int fd) : fd(fd) {}
+
+    FdHandle::~FdHandle() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void Directory::descend(size_t index, std::shared_ptr<void> childContext) {
+        subdirectories.emplace_back(index, std::move(childContext));
+    }
+
+    std::string Directory::child_path(const Entry& entry) const {
+        if (!path.empty() && path.back() == '/') {
+            return path + entry.name;
+        }
+        return path + "/" + entry.name;
+    }
+
+    bool read_entries(int dirfd, std::vector<Entry>& entries, bool hidden) {
+        std::vector<char> buffer(GETDENTS_BUFFER);
+        while (true) {
+            long n = syscall(SYS_getdents64, dirfd, buffer.data(), buffer.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (n == 0) {
+                return true;
+            }
+            for (long offset = 0; offset < n;) {
+                auto* d = reinterpret_cast<linux_dirent64*>(buffer.data() + offset);
+                offset += d->d_reclen;
+                const char* name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+                if (!hidden && name[0] == '.') {
+                    continue;
+                }
+                entries.push_back({name, d->d_type, static_cast<ino_t>(d->d_ino)});
+            }
+        }
+    }
+
+    unsigned char resolve_type(int dirfd, Entry& entry) {
+        if (entry.type != DT_UNKNOWN) {
+            return entry.type;
+        }
+        struct stat st;
+        if (fstatat(dirfd, entry.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            entry.type = IFTODT(st.st_mode);
+        }
+        return entry.type;
+    }
+
+    namespace {
+        std::mutex limitMutex;
+        unsigned limitHolders = 0;
+        bool limitRaised = false;
+        rlim_t savedLimit = 0;
+    }
+
+    FdLimit::FdLimit() {
+        std::lock_guard<std::mutex> lock(limitMutex);
+        if (limitHolders++ > 0) {
+            return;
+        }
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            savedLimit = limit.rlim_cur;
+            limit.rlim_cur = limit.rlim_max;
+            limitRaised = setrlimit(RLIMIT_NOFILE, &limit) == 0;
+        }
+    }
+
+    FdLimit::~FdLimit() {
+        std::lock_guard<std::mutex> lock(limitMutex);
+        if (--limitHolders > 0 || !limitRaised) {
+            return;
+        }
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+            limit.rlim_cur = savedLimit;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+        limitRaised = false;
+    }
+
+    struct WalkState {
+        TaskPool* pool;
+        const Visitor* visit;
+        std::atomic<bool> failed{false};
+    };
+
+    void visit_directory(WalkState& state, Handle parent, const std::string& name, std::string path, int depth, std::shared_ptr<void> context) {
+        int fd = parent ? openat(parent->fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                        : open(name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        parent.reset();                                     // the parent fd is only needed to reach us
+        if (fd < 0) {
+            error_message_no_halt("walk", "Cannot open directory '" + path + "': " + strerror(errno));
+            state.failed = true;
+            return;
+        }
+        Directory directory;
+        directory.handle = std::make_shared<FdHandle>(fd);
+        directory.path = std::move(path);
+        directory.depth = depth;
+        directory.context = std::move(context);
+        if (!read_entries(fd, directory.entries)) {
+            error_message_no_halt("walk", "Cannot read directory '" + directory.path + "': " + strerror(errno));
+            state.failed = true;
+        }
+
+        (*state.visit)(directory);
+
+        for (auto& subdirectory : directory.subdirectories) {
+            const Entry& entry = directory.entries[subdirectory.first];
+            std::string childPath = directory.child_path(entry);
+            Handle handle = directory.handle;
+            std::string childName = entry.name;
+            std::shared_ptr<void> childContext = std::move(subdirectory.second);
+            int childDepth = depth + 1;
+            state.pool->submit([&state, handle, childName, childPath, childDepth, childContext]() mutable {
+                visit_directory(state, std::move(handle), childName, std::move(childPath), childDepth, std::move(childContext));
+            });
+        }
+    }
+
+    bool walk(const std::string& root, unsigned threads, const Visitor& visit, std::shared_ptr<void> rootContext) {
+        FdLimit limit;
+        TaskPool pool(threads);
+        WalkState state;
+        state.pool = &pool;
+        state.visit = &visit;
+        pool.submit([&state, &root, rootContext] {
+            visit_directory(state, nullptr, root, root, 0, rootContext);
+        });
+        pool.wait();
+        return !state.failed;
+    }
+}
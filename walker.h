@@ -0,0 +1,62 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <cstdint>
+#include <dirent.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace walker {
+    struct Entry {
+        std::string name;
+        unsigned char type;         // DT_* from getdents64, DT_UNKNOWN on some filesystems
+        ino_t ino;
+    };
+
+    struct FdHandle {               // closes the fd once the last holder lets go
+        int fd;
+        explicit FdHandle(int fd);
+        ~FdHandle();
+        FdHandle(const FdHandle&) = delete;
+        FdHandle& operator=(const FdHandle&) = delete;
+    };
+    using Handle = std::shared_ptr<FdHandle>;
+
+    struct Directory {
+        Handle handle;              // the directory itself, entries are relative to handle->fd
+        std::string path;           // as reached from the walk root
+        int depth;                  // root is 0
+        std::vector<Entry> entries;
+        std::shared_ptr<void> context;          // whatever the parent passed to descend()
+
+        void descend(size_t index, std::shared_ptr<void> childContext = nullptr);
+        std::string child_path(const Entry& entry) const;
+
+        std::vector<std::pair<size_t, std::shared_ptr<void>>> subdirectories;
+    };
+
+    using Visitor = std::function<void(Directory& directory)>;
+
+    bool read_entries(int dirfd, std::vector<Entry>& entries, bool hidden = true);
+    unsigned char resolve_type(int dirfd, Entry& entry);        // fstatat() only for DT_UNKNOWN
+
+    // Raises the RLIMIT_NOFILE soft limit to the hard limit for as long as one is alive. Holders
+    // share the raise and the last one restores the old limit, so jobs started later inherit it.
+    struct FdLimit {
+        FdLimit();
+        ~FdLimit();
+        FdLimit(const FdLimit&) = delete;
+        FdLimit& operator=(const FdLimit&) = delete;
+    };
+
+    // Visits every directory under root once, on up to threads workers at the same time. The visitor
+    // sees the directory open with its entries read and picks the subdirectories to enter with
+    // descend(). Returns false if any directory could not be opened or read.
+    bool walk(const std::string& root, unsigned threads, const Visitor& visit, std::shared_ptr<void> rootContext = nullptr);
+}
+
+#endif // WALKER_H